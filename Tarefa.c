@@ -1,312 +1,5864 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Tamanho do buffer embutido para descrições curtas (inclui o terminador)
+// Com os encadeamentos por estado, a posição nas colunas e no heap de
+// prioridades e o prazo, uma Task ocupa 80 bytes
+#define INLINE_TEXT_SIZE 22
+
+// Maior prioridade de uma tarefa (0 = padrão, 9 = mais urgente)
+#define MAX_PRIORITY 9
+
+// Marca de Task::heap_pos para tarefas fora do heap de prioridades
+#define NOT_IN_HEAP UINT32_MAX
 
 // Estrutura para representar uma tarefa
 typedef struct Task {
     int id;           // ID único da tarefa
-    char *description; // Descrição da tarefa (alocada dinamicamente)
-    bool completed;   // Indica se a tarefa está concluída (true) ou pendente (false)
+    uint32_t slot;    // Posição nas colunas do layout SoA e, com --dense-ids, no mapa de conclusão
+    char *description; // Descrição da tarefa (inline_desc, tabela de descrições ou snapshot mapeado)
     struct Task *next; // Ponteiro para a próxima tarefa na lista ligada
+    struct Task *prev; // Ponteiro para a tarefa anterior (remoção em O(1))
+    struct Task *state_next; // Próxima tarefa no mesmo estado (pendente/concluída)
+    struct Task *state_prev; // Tarefa anterior no mesmo estado
+    int32_t due;      // Prazo em dias desde 1970-01-01 (0 = sem prazo)
+    uint32_t heap_pos; // Posição no heap de prioridades (NOT_IN_HEAP se não estiver nele)
+    bool completed;   // Indica se a tarefa está concluída (true) ou pendente (false)
+    int8_t priority;  // Prioridade de 0 a MAX_PRIORITY (maior = mais urgente)
+    char inline_desc[INLINE_TEXT_SIZE]; // Armazenamento das descrições curtas
 } Task;
 
+// Entrada do índice hash: guarda o ID junto do ponteiro para que a sondagem
+// não precise acessar o nó da tarefa
+typedef struct {
+    int id;     // ID da tarefa
+    Task *task; // Nó da tarefa (NULL indica posição vazia)
+} TaskIndexEntry;
+
+// Índice hash (ID -> Task*) com endereçamento aberto e sondagem linear
+typedef struct {
+    TaskIndexEntry *entries; // Vetor de posições
+    size_t capacity;         // Número de posições (potência de 2, ou 0 se ainda não alocado)
+    size_t count;            // Número de posições ocupadas
+} TaskIndex;
+
+// Bloco (slab) de um pool de nós; os nós vêm logo após o cabeçalho
+typedef struct PoolSlab {
+    struct PoolSlab *next; // Próximo bloco alocado pelo mesmo pool
+} PoolSlab;
+
+// Alocador de nós de tamanho fixo (Task/Action)
+// Reserva blocos grandes de uma vez e reaproveita nós liberados por uma lista livre
+typedef struct {
+    size_t node_size;      // Tamanho de cada nó (arredondado para alinhamento)
+    size_t nodes_per_slab; // Quantos nós cabem em cada bloco
+    PoolSlab *slabs;       // Blocos alocados (liberados de uma vez no destroy)
+    char *cursor;          // Próximo nó nunca usado do bloco atual
+    char *limit;           // Fim do bloco atual
+    void *free_list;       // Nós devolvidos, prontos para reuso
+    size_t reserved;       // Nós ainda a recortar do bloco atual antes da lista livre
+} NodePool;
+
+// Chaves por nó da árvore ordenada (nó de ~400 bytes, poucas linhas de cache)
+#define ORDER_NODE_KEYS 32
+
+// Nó da árvore B+ do índice ordenado
+// Folhas guardam pares ID -> Task* e formam uma lista duplamente encadeada em
+// ordem crescente; nós internos guardam 'count' separadores e 'count + 1'
+// filhos, onde keys[i] é o menor ID alcançável por children[i + 1]
+typedef struct OrderNode {
+    int count;                       // Chaves em uso
+    bool leaf;                       // Verdadeiro para folhas
+    int keys[ORDER_NODE_KEYS];       // IDs (folha) ou separadores (interno), em ordem
+    union {
+        Task *tasks[ORDER_NODE_KEYS];                   // Tarefas (folha)
+        struct OrderNode *children[ORDER_NODE_KEYS + 1]; // Filhos (interno)
+    };
+    struct OrderNode *prev; // Folha anterior (só em folhas)
+    struct OrderNode *next; // Próxima folha (só em folhas)
+} OrderNode;
+
+// Índice ordenado por ID (árvore B+) para percorrer as tarefas em ordem de ID
+// e buscar intervalos em O(log n)
+typedef struct {
+    OrderNode *root;  // Raiz (NULL se vazio)
+    OrderNode *first; // Folha mais à esquerda
+    NodePool nodes;   // Pool de onde saem os nós
+} OrderedIndex;
+
+// Posição numa varredura do índice ordenado
+typedef struct {
+    OrderNode *leaf; // Folha atual (NULL no fim)
+    int pos;         // Posição dentro da folha
+} OrderCursor;
+
+// Termo do índice de busca com a lista (postings) dos IDs cujas descrições o
+// contêm, em ordem crescente e sem repetição
+typedef struct SearchTerm {
+    struct SearchTerm *next; // Próximo termo no mesmo balde
+    uint32_t hash;           // Hash FNV-1a do termo
+    uint32_t length;         // Comprimento do termo
+    int *ids;                // IDs das tarefas que contêm o termo
+    size_t count;            // Número de IDs
+    size_t capacity;         // Capacidade do vetor de IDs
+    char text[];             // Termo (minúsculo), sem terminador
+} SearchTerm;
+
+// Índice invertido de busca: termo -> IDs (hash com encadeamento)
+// Só é construído na primeira busca; a partir daí acompanha cada tarefa que
+// entra ou sai da lista
+typedef struct {
+    SearchTerm **buckets; // Vetor de baldes (potência de 2, ou NULL se vazio)
+    size_t capacity;      // Número de baldes
+    size_t count;         // Número de termos distintos
+    bool built;           // Falso até a primeira busca (nada é indexado antes)
+} SearchIndex;
+
+// Posição de uma descrição dentro do pacote de descrições
+typedef struct {
+    int id;        // ID da tarefa
+    size_t offset; // Início da descrição em DescriptionPack::text
+} PackEntry;
+
+// Cópia contígua de todas as descrições, separadas por '\0', para a busca
+// por trecho percorrer um único bloco de memória com instruções vetoriais
+// Adições são acrescentadas no fim; qualquer remoção invalida o pacote, que
+// é remontado na busca seguinte
+typedef struct {
+    char *text;         // Descrições, cada uma seguida de '\0'
+    size_t used;        // Bytes ocupados em 'text'
+    size_t capacity;    // Capacidade de 'text'
+    PackEntry *entries; // Uma entrada por descrição, na ordem de 'text'
+    size_t count;       // Número de entradas
+    size_t entry_capacity;
+    bool valid;         // Falso até a primeira busca e depois de qualquer remoção
+} DescriptionPack;
+
+// Organização da memória da lista
+typedef enum {
+    LAYOUT_LINKED,  // Só os nós encadeados (padrão)
+    LAYOUT_COLUMNS  // Nós mais colunas paralelas (SoA) para as varreduras
+} TaskLayout;
+
+// Colunas paralelas (structure of arrays) com uma posição por tarefa na lista
+// A posição de uma tarefa (Task::slot) não muda enquanto ela estiver na lista;
+// ao sair, a posição vira lápide (bit 'live' zerado) e é reaproveitada pela
+// próxima tarefa que entrar. Varreduras por estado leem 64 tarefas por palavra
+// dos bitsets, sem seguir ponteiros entre nós
+typedef struct {
+    int *ids;                  // ID da tarefa em cada posição
+    const char **descriptions; // Descrição da tarefa em cada posição
+    uint64_t *completed;       // Bitset: tarefa concluída
+    uint64_t *live;            // Bitset: posição ocupada (0 = lápide)
+    size_t count;              // Posições em uso, contando lápides
+    size_t capacity;           // Capacidade das colunas (múltiplo de 64)
+    uint32_t *free_slots;      // Lápides disponíveis para reuso (pilha)
+    size_t free_count;         // Número de lápides
+} TaskColumns;
+
+// Mapa de conclusão denso, indexado por ID: um bit de presença e um de
+// conclusão por ID já emitido, para contar intervalos com popcount e concluir
+// intervalos palavra a palavra
+// Com --dense-ids, é indexado pela posição da tarefa (Task::slot), que é
+// reaproveitada, e não cresce com os IDs emitidos
+typedef struct {
+    uint64_t *present;   // Bit 1: a tarefa com esse ID está na lista
+    uint64_t *completed; // Bit 1: a tarefa com esse ID está concluída
+    size_t words;        // Palavras de cada bitset
+    bool by_slot;        // Indexado por Task::slot em vez do ID (--dense-ids)
+} CompletionMap;
+
+// Posições livres do mapa de conclusão no modo de IDs densos (--dense-ids)
+// Com o layout ligado, cada tarefa na lista ocupa uma posição (Task::slot),
+// devolvida quando ela sai da lista; as menores são reaproveitadas primeiro
+typedef struct {
+    uint64_t *bits; // Bit 1: a posição está livre
+    size_t words;   // Palavras de 'bits'
+    size_t hint;    // Nenhuma palavra antes desta tem bit 1
+    size_t count;   // Número de posições livres
+    uint32_t used;  // Posições já emitidas (todas as livres estão abaixo)
+} FreeSlots;
+
+// Conjunto de IDs em [first, last] como bitset, em palavras alinhadas como no
+// mapa de conclusão: bits[k] cobre os IDs da palavra first / 64 + k
+typedef struct {
+    int first;      // Menor ID do conjunto
+    int last;       // Maior ID do conjunto
+    uint64_t *bits; // Bitset dos IDs (NULL se vazio)
+} IdSet;
+
+// Posição numa varredura dos IDs de um conjunto, em ordem crescente
+typedef struct {
+    const uint64_t *bits;
+    size_t base;     // Palavra do mapa correspondente a bits[0]
+    size_t words;    // Palavras do conjunto
+    size_t k;        // Palavra atual
+    uint64_t word;   // Bits ainda não visitados da palavra atual
+} IdSetCursor;
+
+// Pedaço (chunk) da arena de texto
+typedef struct TextChunk {
+    struct TextChunk *next; // Próximo pedaço da arena
+} TextChunk;
+
+// Cabeçalho de um texto grande demais para a arena (alocado com malloc)
+typedef struct LargeText {
+    struct LargeText *prev;
+    struct LargeText *next;
+} LargeText;
+
+// Granularidade e limite das classes de tamanho da arena de texto
+#define TEXT_CLASS_SIZE 16
+#define TEXT_CLASS_COUNT 32 // Textos de até 512 bytes ficam na arena
+
+// Arena de texto para as descrições
+// Aloca por incremento de ponteiro (bump) dentro de pedaços grandes; blocos
+// liberados voltam para uma lista livre por classe de tamanho
+typedef struct {
+    TextChunk *chunks;                   // Pedaços alocados
+    char *cursor;                        // Próximo byte livre do pedaço atual
+    char *limit;                         // Fim do pedaço atual
+    void *free_lists[TEXT_CLASS_COUNT];  // Blocos livres por classe de tamanho
+    LargeText *large;                    // Textos grandes, alocados individualmente
+} TextArena;
+
+// Descrição longa internada: guardada uma única vez e compartilhada por
+// contagem de referências entre todas as tarefas com o mesmo texto
+typedef struct InternedText {
+    struct InternedText *next; // Próxima entrada no mesmo balde
+    uint32_t hash;             // Hash FNV-1a do texto
+    uint32_t refs;             // Número de tarefas que referenciam o texto
+    uint32_t length;           // Comprimento do texto (sem o terminador)
+    char text[];               // Bytes do texto, com terminador
+} InternedText;
+
+// Leitor que pode continuar usando descrições depois de soltar a trava da lista
+// (no modo servidor, cada cliente tem um)
+typedef struct ReaderSlot {
+    struct ReaderSlot *next;
+    _Atomic uint64_t epoch; // Época fixada no início da leitura (0 = fora de uma leitura)
+} ReaderSlot;
+
+// Texto internado que perdeu a última referência, à espera dos leitores
+typedef struct {
+    InternedText *entry;
+    uint64_t epoch; // Época em que saiu da tabela
+} RetiredText;
+
+// Reclamação por épocas dos textos internados
+// Um texto solto enquanto há leitores registrados só volta à arena quando
+// todos os leitores em andamento começaram depois dele, pois só esses não
+// podem ter guardado um ponteiro para ele
+typedef struct {
+    _Atomic uint64_t epoch;  // Época atual (começa em 1)
+    ReaderSlot *readers;     // Leitores registrados (NULL = libera na hora)
+    pthread_mutex_t lock;    // Protege 'readers' entre registro e varredura
+    RetiredText *retired;    // Fila de textos aposentados, em ordem de época
+    size_t retired_start;    // Primeiro texto ainda na fila
+    size_t retired_count;    // Fim da fila
+    size_t retired_capacity;
+    _Atomic bool retired_waiting; // A fila não está vazia (lido sem a trava da lista)
+} ReaderEpochs;
+
+// Tabela de descrições internadas (hash com encadeamento)
+typedef struct {
+    InternedText **buckets; // Vetor de baldes (potência de 2, ou NULL se vazio)
+    size_t capacity;        // Número de baldes
+    size_t count;           // Número de textos distintos
+    ReaderEpochs epochs;    // Leitores que ainda podem ver textos soltos
+} StringTable;
+
+// Heap binário indexado das tarefas pendentes, da mais urgente para a menos
+// urgente. Cada tarefa guarda sua posição (Task::heap_pos), então retirar ou
+// reposicionar uma tarefa qualquer custa O(log n)
+typedef struct {
+    Task **items;    // items[0] é a próxima tarefa a fazer
+    size_t count;
+    size_t capacity;
+} TaskHeap;
+
 // Estrutura para a lista ligada de tarefas
 typedef struct {
     Task *head; // Ponteiro para o primeiro nó da lista
     Task *tail; // Ponteiro para o último nó da lista (para inserção O(1) no final)
+    Task *state_head[2];  // Primeira tarefa de cada estado, indexado por 'completed'
+    Task *state_tail[2];  // Última tarefa de cada estado
+    size_t state_count[2]; // Número de tarefas em cada estado
     int next_id; // Próximo ID disponível para uma nova tarefa
+    TaskIndex index; // Índice por ID para buscas em tempo constante
+    OrderedIndex order; // Índice ordenado por ID (varredura em ordem e intervalos)
+    SearchIndex search; // Índice invertido das palavras das descrições
+    DescriptionPack pack; // Descrições contíguas para a busca por trecho
+    TaskLayout layout;    // Organização escolhida para esta lista
+    TaskColumns columns;  // Colunas SoA (só com LAYOUT_COLUMNS)
+    CompletionMap completion; // Presença e conclusão por ID (ou por posição)
+    FreeSlots free_slots; // Posições para reaproveitar (só com --dense-ids)
+    TaskHeap agenda;    // Tarefas pendentes por prioridade e prazo
+    NodePool task_pool; // Pool dos nós de tarefa
+    TextArena text;     // Arena de onde saem as descrições internadas
+    StringTable strings; // Descrições longas internadas
+    const char *mapped;  // Snapshot mapeado em memória (NULL se não houver)
+    size_t mapped_size;  // Tamanho do mapeamento
 } TaskList;
 
+// Filtro de estado para a listagem
+typedef enum {
+    FILTER_ALL,
+    FILTER_PENDING,
+    FILTER_COMPLETED
+} StateFilter;
+
+// Critérios de uma listagem filtrada e paginada
+typedef struct {
+    StateFilter state; // Estado das tarefas listadas
+    int min_id;        // Menor ID listado
+    int max_id;        // Maior ID listado
+    size_t offset;     // Quantas tarefas que passam no filtro pular antes de listar
+    size_t limit;      // Máximo de tarefas listadas (0 = sem limite)
+    bool sorted;       // Lista em ordem de ID (sempre verdade com intervalo de IDs)
+} TaskFilter;
+
+
+// Tipos de registro do diário (journal) de persistência
+// Cada registro descreve o efeito final sobre a lista, então desfazer e
+// refazer também são gravados como ADD/STATE/REMOVE
+typedef enum {
+    JOURNAL_ADD = 1,   // Tarefa inserida no final da lista (com estado e descrição)
+    JOURNAL_STATE = 2, // Estado de conclusão alterado
+    JOURNAL_REMOVE = 3, // Tarefa retirada da lista
+    JOURNAL_SCHEDULE = 4 // Prioridade e prazo alterados (1 byte de prioridade e 4 do prazo)
+} JournalRecordType;
+
+// Cabeçalho do snapshot binário (formato fixo, na ordem de bytes da máquina)
+typedef struct {
+    char magic[8];     // SNAPSHOT_MAGIC
+    uint64_t lsn;      // Último LSN do diário incluído no snapshot
+    int32_t next_id;   // Próximo ID da lista
+    uint32_t reserved;
+    uint64_t count;    // Número de registros de tarefa
+} SnapshotHeader;
+
+// Registro de tarefa do snapshot; a descrição fica no blob de texto que segue
+// o vetor de registros, com terminador, para poder ser usada diretamente
+typedef struct {
+    int32_t id;
+    uint32_t flags;    // Bit 0: tarefa concluída; bits 8 a 15: prioridade
+    uint64_t offset;   // Posição da descrição dentro do blob
+    uint32_t length;   // Comprimento da descrição (sem o terminador)
+    int32_t due;       // Prazo, como em Task::due
+} SnapshotRecord;
+
+// Armazenamento persistente da lista: snapshot compactado + diário só de acréscimo
+// Cada registro do diário tem um número de sequência (LSN); o snapshot guarda o
+// último LSN que já contém, e só os registros posteriores são reaplicados
+typedef struct {
+    TaskList *list;          // Lista persistida
+    int journal_fd;          // Diário aberto para acréscimo (-1 = persistência desligada)
+    char *dir_path;          // Diretório dos arquivos
+    char *journal_path;      // Caminho do diário
+    char *snapshot_path;     // Caminho do snapshot
+    char *next_journal_path; // Diário que recebe os registros durante uma compactação
+    pid_t compaction_pid;    // Processo que grava o snapshot em segundo plano (0 = nenhum)
+    uint64_t compaction_lsn; // LSN do snapshot sendo gravado por ele
+    uint64_t next_lsn;       // LSN do próximo registro
+    uint64_t snapshot_lsn;   // Último LSN incluído no snapshot
+    size_t journal_records;  // Registros gravados no diário desde o último snapshot
+    size_t compact_every;    // Compacta ao atingir este número de registros (0 = só ao sair)
+    unsigned char *buffer;   // Registros montados e ainda não gravados
+    size_t buffer_used;      // Bytes ocupados no buffer
+    size_t buffer_capacity;
+    int batch_depth;         // > 0 enquanto um lote agrupa registros numa única gravação
+    // Gravação em segundo plano (só com a thread escritora ligada)
+    bool writer_running;     // Há uma thread escritora; as gravações não bloqueiam
+    bool writer_stop;        // Pede que a escritora grave o que falta e termine
+    pthread_t writer;
+    pthread_mutex_t lock;    // Protege o buffer, os LSNs e os campos da escritora
+    pthread_mutex_t io_lock; // Serializa as escritas no arquivo do diário com a compactação
+    pthread_cond_t wake;     // Acorda a escritora
+    pthread_cond_t synced;   // Avisa quem espera em journalSync
+    unsigned char *spare;    // Segundo buffer, trocado com 'buffer' a cada gravação
+    size_t spare_capacity;
+    size_t pending_records;  // Registros no buffer ainda não entregues à escritora
+    size_t sync_records;     // Grava assim que houver este número de registros pendentes
+    unsigned int sync_window_ms; // Espera no máximo isto antes de gravar um registro
+    int sync_waiters;        // Chamadas de journalSync esperando
+    uint64_t durable_lsn;    // Maior LSN já durável no disco
+} TaskStore;
 
 // Tipos de ações que podem ser desfeitas
 typedef enum {
     ACTION_ADD,
     ACTION_COMPLETE,
-    ACTION_REMOVE
+    ACTION_REMOVE,
+    ACTION_IMPORT,       // Importação em lote de tarefas com IDs consecutivos
+    ACTION_COMPLETE_SET, // Conclusão de um conjunto de tarefas (lista ou intervalo de IDs)
+    ACTION_REMOVE_SET,   // Remoção de um conjunto de tarefas (lista ou intervalo de IDs)
+    ACTION_SCHEDULE      // Mudança de prioridade ou prazo de uma tarefa
 } ActionType;
 
-// Estrutura para armazenar informações de uma ação
+// Estrutura para armazenar informações de uma ação (forma decodificada; na
+// pilha as ações ficam codificadas, ver ActionStack)
+// Cada tipo guarda apenas o necessário para ser desfeito: ADD só o ID,
+// COMPLETE o ID e o estado anterior, REMOVE o próprio nó removido, IMPORT
+// o primeiro ID e a quantidade e SCHEDULE a prioridade e o prazo a restaurar
 typedef struct Action {
     ActionType type;       // Tipo da ação
-    int task_id;           // ID da tarefa envolvida na ação
-    char *task_description; // Descrição da tarefa (para REMOVE e ADD)
+    int task_id;           // ID da tarefa envolvida na ação (menor ID, para IMPORT e conjuntos)
+    int count;             // Número de IDs cobertos a partir de task_id (para IMPORT e conjuntos)
+    int32_t due;           // Prazo a restaurar (para SCHEDULE)
     bool was_completed;     // Estado anterior da tarefa (para COMPLETE)
-    struct Action *next;   // Ponteiro para a próxima ação na pilha
+    int8_t priority;       // Prioridade a restaurar (para SCHEDULE)
+    Task *task;            // Nós fora da lista, de posse da ação, encadeados por 'next'
+    uint64_t *bits;        // IDs afetados (para conjuntos), como em IdSet::bits
 } Action;
 
 // Estrutura para a pilha de ações (histórico)
+// As ações ficam num log de bytes só de acréscimo. Cada registro tem uma
+// etiqueta (tipo e presença dos campos opcionais), a diferença entre o seu
+// ID e o do registro anterior em varint zigzag e só os campos que o tipo
+// usa; um byte final com o tamanho do registro permite decodificar o topo de
+// trás para frente. Um ADD ou COMPLETE de IDs próximos ocupa 3 bytes. Com
+// profundidade limitada, a ação mais antiga é descartada do início do log
 typedef struct {
-    Action *top; // Ponteiro para o topo da pilha
+    unsigned char *log; // Registros codificados
+    size_t start;     // Início do registro mais antigo
+    size_t used;      // Fim do registro mais recente
+    size_t capacity;  // Tamanho alocado de 'log'
+    size_t count;     // Número de ações na pilha
+    int base_id;      // ID a que o registro mais antigo se refere
+    int last_id;      // ID do registro mais recente (referência do próximo)
+    size_t max_depth; // Profundidade máxima (0 = ilimitada)
+    TaskList *list;   // Lista dona dos nós guardados nas ações
 } ActionStack;
 
-// --- Funções da Lista de Tarefas ---
+// Histórico completo: ações que podem ser desfeitas e ações desfeitas que
+// podem ser refeitas. Os registros passam de uma pilha para a outra
+// decodificados e codificados de novo, sem alocação por ação
+typedef struct {
+    ActionStack undo; // Ações feitas (para Desfazer)
+    ActionStack redo; // Ações desfeitas (para Refazer)
+    TaskStore *store; // Persistência que recebe o efeito de cada ação (NULL = desligada)
+} History;
 
-// Inicializa a lista de tarefas
-void initTaskList(TaskList *list) {
-    list->head = NULL;
-    list->tail = NULL;
-    list->next_id = 1; // Começa os IDs das tarefas a partir de 1
+// Tamanho do buffer de saída agrupada
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+// Máximo de trechos por chamada a writev
+#define OUTPUT_IOV_COUNT 64
+// Textos a partir deste tamanho são enviados direto da memória onde já estão, sem cópia
+#define OUTPUT_DIRECT_MIN 256
+
+// Saída capturada na memória para ser enviada depois (listagens do modo servidor)
+// As partes copiadas ficam em blocos próprios; os textos longos continuam
+// apontando para as descrições da lista, protegidas pela época do leitor
+typedef struct {
+    struct iovec *iov; // Trechos a emitir, na ordem
+    size_t count;
+    size_t capacity;
+    char **blocks;     // Cópias dos dados de OutputBuffer
+    size_t block_count;
+    size_t block_capacity;
+} OutputCapture;
+
+// Saída agrupada: o texto formatado é acumulado em 'data' e textos longos
+// entram como trechos que apontam para a própria memória deles; tudo é
+// emitido com o mínimo possível de chamadas a writev
+typedef struct {
+    int fd;                              // Descritor de destino
+    OutputCapture *capture;              // Se não for NULL, recebe a saída em vez de 'fd'
+    size_t used;                         // Bytes ocupados em 'data'
+    size_t pending;                      // Início do trecho de 'data' ainda fora de 'iov'
+    int iov_count;                       // Trechos prontos em 'iov'
+    struct iovec iov[OUTPUT_IOV_COUNT];  // Trechos a emitir, na ordem
+    char data[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
+
+// --- Contadores de Instrumentação ---
+
+// Contadores dos caminhos quentes, mostrados pelo comando stats
+// Compilar com -DTAREFA_NO_COUNTERS remove todos eles: COUNT vira nada e os
+// totais ficam em zero
+typedef enum {
+    COUNTER_COMMANDS,       // Comandos executados pelo modo em lote ou servidor
+    COUNTER_ACTIONS,        // Ações registradas no histórico
+    COUNTER_LOOKUPS,        // Buscas por ID
+    COUNTER_PROBES,         // Entradas do índice hash visitadas nessas buscas
+    COUNTER_NODE_ALLOCS,    // Nós tirados do pool
+    COUNTER_TEXT_ALLOCS,    // Blocos tirados da arena de texto
+    COUNTER_MALLOCS,        // Blocos pedidos ao malloc pelo pool e pela arena
+    COUNTER_LISTINGS,       // Listagens emitidas
+    COUNTER_LISTED,         // Linhas listadas
+    COUNTER_LISTING_TICKS,  // Tempo gasto nas listagens (ver COUNTER_TICK_UNIT)
+    COUNTER_COUNT
+} Counter;
+
+// Nomes dos contadores no dump legível por máquina
+static const char *const counter_names[COUNTER_COUNT] = {
+    "commands", "actions", "lookups", "probes", "node_allocs",
+    "text_allocs", "mallocs", "listings", "listed", "listing_ticks"
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COUNTER_TICK_UNIT "ciclos"
+#else
+#define COUNTER_TICK_UNIT "ns"
+#endif
+
+// Relógio dos temporizadores: contador de ciclos do processador onde houver
+uint64_t counterTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
 }
 
-// Aloca e cria uma nova tarefa
-Task *createTask(int id, const char *description) {
-    Task *newTask = (Task *)malloc(sizeof(Task));
-    if (!newTask) {
-        perror("Erro ao alocar memória para a tarefa");
+#ifndef TAREFA_NO_COUNTERS
+
+// Contadores de uma thread: só ela escreve neles, sem instruções atômicas
+// caras; o stats soma os blocos de todas as threads. Quando a thread termina,
+// o bloco fica livre e a próxima thread continua somando nele, então os
+// totais nunca se perdem
+typedef struct CounterBlock {
+    _Atomic uint64_t values[COUNTER_COUNT];
+    struct CounterBlock *next; // Próximo bloco registrado
+    bool in_use;               // Pertence a uma thread viva (protegido por counter_lock)
+} CounterBlock;
+
+static CounterBlock *counter_blocks = NULL; // Todos os blocos já criados
+static pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t counter_key;           // Libera o bloco quando a thread termina
+static pthread_once_t counter_once = PTHREAD_ONCE_INIT;
+static __thread CounterBlock *thread_counters = NULL;
+
+void releaseCounterBlock(void *block) {
+    pthread_mutex_lock(&counter_lock);
+    ((CounterBlock *)block)->in_use = false;
+    pthread_mutex_unlock(&counter_lock);
+}
+
+void createCounterKey(void) {
+    pthread_key_create(&counter_key, releaseCounterBlock);
+}
+
+// Bloco da thread atual, reaproveitando um livre ou criando um na primeira vez
+CounterBlock *claimCounterBlock(void) {
+    pthread_once(&counter_once, createCounterKey);
+    pthread_mutex_lock(&counter_lock);
+    CounterBlock *block = counter_blocks;
+    while (block != NULL && block->in_use) {
+        block = block->next;
+    }
+    if (block == NULL) {
+        block = (CounterBlock *)calloc(1, sizeof(CounterBlock));
+        if (!block) {
+            perror("Erro ao alocar memória para os contadores");
+            exit(EXIT_FAILURE);
+        }
+        block->next = counter_blocks;
+        counter_blocks = block;
+    }
+    block->in_use = true;
+    pthread_mutex_unlock(&counter_lock);
+    pthread_setspecific(counter_key, block);
+    thread_counters = block;
+    return block;
+}
+
+// Soma 'amount' a um contador da thread atual
+void countEvent(Counter counter, uint64_t amount) {
+    CounterBlock *block = thread_counters != NULL ? thread_counters : claimCounterBlock();
+    _Atomic uint64_t *value = &block->values[counter];
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// Total de um contador somado sobre todas as threads
+uint64_t counterTotal(Counter counter) {
+    uint64_t total = 0;
+    pthread_mutex_lock(&counter_lock);
+    for (const CounterBlock *block = counter_blocks; block != NULL; block = block->next) {
+        total += atomic_load_explicit(&block->values[counter], memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&counter_lock);
+    return total;
+}
+
+#define COUNT(counter, amount) countEvent((counter), (amount))
+
+#else
+
+#define COUNT(counter, amount) ((void)0)
+
+uint64_t counterTotal(Counter counter) {
+    (void)counter;
+    return 0;
+}
+
+#endif
+
+// --- Funções da Saída Agrupada ---
+
+// Prepara a saída agrupada para 'fd'
+// Quem escreve no mesmo descritor via stdio deve chamar fflush antes
+void initOutputBuffer(OutputBuffer *out, int fd) {
+    out->fd = fd;
+    out->capture = NULL;
+    out->used = 0;
+    out->pending = 0;
+    out->iov_count = 0;
+}
+
+// Fecha o trecho de 'data' acumulado desde o último, transformando-o num iovec
+void outputCloseSegment(OutputBuffer *out) {
+    if (out->used > out->pending) {
+        out->iov[out->iov_count].iov_base = out->data + out->pending;
+        out->iov[out->iov_count].iov_len = out->used - out->pending;
+        out->iov_count++;
+        out->pending = out->used;
+    }
+}
+
+// Escreve os 'count' trechos de 'iov' em 'fd', repetindo writev em escritas parciais
+// 'iov' é modificado. Retorna false em erro de escrita
+bool writeAllIov(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return true;
+}
+
+// Inicializa uma captura vazia
+void initOutputCapture(OutputCapture *capture) {
+    capture->iov = NULL;
+    capture->count = 0;
+    capture->capacity = 0;
+    capture->blocks = NULL;
+    capture->block_count = 0;
+    capture->block_capacity = 0;
+}
+
+// Garante espaço na captura para mais um bloco e 'segments' trechos
+void captureReserve(OutputCapture *capture, size_t segments) {
+    if (capture->block_count == capture->block_capacity) {
+        size_t new_capacity = capture->block_capacity ? capture->block_capacity * 2 : 16;
+        char **blocks = (char **)realloc(capture->blocks, new_capacity * sizeof(char *));
+        if (!blocks) {
+            perror("Erro ao alocar memória para a saída capturada");
+            exit(EXIT_FAILURE);
+        }
+        capture->blocks = blocks;
+        capture->block_capacity = new_capacity;
+    }
+    if (capture->count + segments > capture->capacity) {
+        size_t new_capacity = capture->capacity ? capture->capacity * 2 : 256;
+        while (new_capacity < capture->count + segments) {
+            new_capacity *= 2;
+        }
+        struct iovec *iov = (struct iovec *)realloc(capture->iov, new_capacity * sizeof(struct iovec));
+        if (!iov) {
+            perror("Erro ao alocar memória para a saída capturada");
+            exit(EXIT_FAILURE);
+        }
+        capture->iov = iov;
+        capture->capacity = new_capacity;
+    }
+}
+
+// Acrescenta à captura um texto alocado com malloc, que passa a ser dela
+void captureText(OutputCapture *capture, char *text, size_t length) {
+    captureReserve(capture, 1);
+    capture->blocks[capture->block_count++] = text;
+    capture->iov[capture->count].iov_base = text;
+    capture->iov[capture->count].iov_len = length;
+    capture->count++;
+}
+
+// Move os trechos acumulados em 'out' para a captura, copiando os dados de 'out'
+void captureOutput(OutputCapture *capture, OutputBuffer *out) {
+    captureReserve(capture, (size_t)out->iov_count);
+    char *block = NULL;
+    if (out->used > 0) {
+        block = (char *)malloc(out->used);
+        if (!block) {
+            perror("Erro ao alocar memória para a saída capturada");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(block, out->data, out->used);
+        capture->blocks[capture->block_count++] = block;
+    }
+    for (int i = 0; i < out->iov_count; i++) {
+        struct iovec segment = out->iov[i];
+        char *base = (char *)segment.iov_base;
+        if (base >= out->data && base < out->data + OUTPUT_BUFFER_SIZE) {
+            segment.iov_base = block + (base - out->data); // Trecho copiado
+        }
+        capture->iov[capture->count++] = segment;
+    }
+}
+
+// Envia a saída capturada para 'fd' e libera a captura
+// Retorna false em erro de escrita
+bool sendOutputCapture(OutputCapture *capture, int fd) {
+    bool ok = true;
+    for (size_t i = 0; ok && i < capture->count; i += OUTPUT_IOV_COUNT) {
+        size_t count = capture->count - i < OUTPUT_IOV_COUNT ? capture->count - i : OUTPUT_IOV_COUNT;
+        ok = writeAllIov(fd, capture->iov + i, (int)count);
+    }
+    for (size_t i = 0; i < capture->block_count; i++) {
+        free(capture->blocks[i]);
+    }
+    free(capture->blocks);
+    free(capture->iov);
+    initOutputCapture(capture);
+    return ok;
+}
+
+// Emite todos os trechos acumulados (ou os passa para a captura, se houver)
+// Retorna false em erro de escrita (a saída pendente é descartada)
+bool flushOutput(OutputBuffer *out) {
+    outputCloseSegment(out);
+    bool ok = true;
+    if (out->capture != NULL) {
+        captureOutput(out->capture, out);
+    } else {
+        ok = writeAllIov(out->fd, out->iov, out->iov_count);
+    }
+    out->used = 0;
+    out->pending = 0;
+    out->iov_count = 0;
+    return ok;
+}
+
+// Acrescenta 'length' bytes à saída
+// Textos longos não são copiados e precisam continuar válidos até o flushOutput
+void outputBytes(OutputBuffer *out, const char *text, size_t length) {
+    if (length >= OUTPUT_DIRECT_MIN) {
+        if (out->iov_count + 2 > OUTPUT_IOV_COUNT) {
+            flushOutput(out);
+        }
+        outputCloseSegment(out);
+        out->iov[out->iov_count].iov_base = (void *)text;
+        out->iov[out->iov_count].iov_len = length;
+        out->iov_count++;
+        return;
+    }
+    if (out->used + length > OUTPUT_BUFFER_SIZE || out->iov_count + 1 >= OUTPUT_IOV_COUNT) {
+        flushOutput(out);
+    }
+    memcpy(out->data + out->used, text, length);
+    out->used += length;
+}
+
+// Acrescenta um texto literal (tamanho conhecido em tempo de compilação)
+#define outputLiteral(out, literal) outputBytes((out), (literal), sizeof(literal) - 1)
+
+// Acrescenta um inteiro em decimal, sem passar por printf
+void outputInt(OutputBuffer *out, int value) {
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    outputBytes(out, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+// --- Mensagens ---
+
+// Quando verdadeiro, as confirmações de cada operação não são impressas
+// (modo em lote com --quiet); erros e listagens continuam aparecendo
+bool quiet_mode = false;
+
+// Destino das mensagens e listagens da thread atual (NULL = saída padrão)
+// No modo servidor, cada thread de cliente aponta para o próprio socket
+static __thread FILE *thread_output = NULL;
+
+// Captura que recebe as mensagens e listagens da thread atual (NULL = emitidas na hora)
+// Assim, tudo o que um comando imprime sai na ordem em que foi produzido
+static __thread OutputCapture *thread_capture = NULL;
+
+// Fluxo que recebe as mensagens de quem emitiu o comando em execução
+FILE *messageStream(void) {
+    return thread_output != NULL ? thread_output : stdout;
+}
+
+// Formata uma mensagem para quem emitiu o comando (ou para a captura da thread)
+void emitMessage(const char *format, va_list args) {
+    if (thread_capture == NULL) {
+        vfprintf(messageStream(), format, args);
+        return;
+    }
+    va_list copy;
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length <= 0) {
+        return;
+    }
+    char *text = (char *)malloc((size_t)length + 1);
+    if (!text) {
+        perror("Erro ao alocar memória para a saída capturada");
         exit(EXIT_FAILURE);
     }
-    newTask->id = id;
-    newTask->description = strdup(description); // Alocação dinâmica para a descrição
-    if (!newTask->description) {
-        perror("Erro ao alocar memória para a descrição da tarefa");
-        free(newTask);
+    vsnprintf(text, (size_t)length + 1, format, args);
+    captureText(thread_capture, text, (size_t)length);
+}
+
+// Imprime uma mensagem para quem emitiu o comando, mesmo no modo silencioso
+void report(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    emitMessage(format, args);
+    va_end(args);
+}
+
+// Imprime uma mensagem de confirmação, a menos que o modo silencioso esteja ativo
+void notify(const char *format, ...) {
+    if (quiet_mode) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    emitMessage(format, args);
+    va_end(args);
+}
+
+// --- Funções dos Alocadores (Pool de Nós e Arena de Texto) ---
+
+// Tamanho alvo de cada bloco/pedaço alocado do sistema
+#define ALLOC_SLAB_BYTES (64 * 1024)
+
+// Arredonda um tamanho para múltiplo de 'align' (potência de 2)
+size_t alignSize(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Inicializa um pool para nós de 'node_size' bytes
+void initNodePool(NodePool *pool, size_t node_size) {
+    pool->node_size = alignSize(node_size < sizeof(void *) ? sizeof(void *) : node_size, sizeof(void *));
+    pool->nodes_per_slab = (ALLOC_SLAB_BYTES - alignSize(sizeof(PoolSlab), 16)) / pool->node_size;
+    pool->slabs = NULL;
+    pool->cursor = NULL;
+    pool->limit = NULL;
+    pool->free_list = NULL;
+    pool->reserved = 0;
+}
+
+// Obtém um nó do pool (reaproveitado ou recortado do bloco atual)
+void *poolAlloc(NodePool *pool) {
+    COUNT(COUNTER_NODE_ALLOCS, 1);
+    if (pool->reserved > 0) {
+        pool->reserved--; // Poupado por poolReserve: o bloco atual tem espaço
+    } else if (pool->free_list != NULL) {
+        void *node = pool->free_list;
+        pool->free_list = *(void **)node;
+        return node;
+    }
+    if (pool->cursor == pool->limit) {
+        size_t header = alignSize(sizeof(PoolSlab), 16);
+        PoolSlab *slab = (PoolSlab *)malloc(header + pool->nodes_per_slab * pool->node_size);
+        COUNT(COUNTER_MALLOCS, 1);
+        if (!slab) {
+            perror("Erro ao alocar bloco do pool de nós");
+            exit(EXIT_FAILURE);
+        }
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->cursor = (char *)slab + header;
+        pool->limit = pool->cursor + pool->nodes_per_slab * pool->node_size;
+    }
+    void *node = pool->cursor;
+    pool->cursor += pool->node_size;
+    return node;
+}
+
+// Garante que os próximos 'count' nós saiam de um único bloco contíguo
+// Até lá, a lista livre não é usada; se o bloco atual não comportar todos,
+// os nós restantes dele vão para a lista livre e um bloco novo é alocado
+void poolReserve(NodePool *pool, size_t count) {
+    pool->reserved = count;
+    if ((size_t)(pool->limit - pool->cursor) >= count * pool->node_size) {
+        return;
+    }
+    while (pool->cursor != pool->limit) {
+        void *node = pool->cursor;
+        pool->cursor += pool->node_size;
+        *(void **)node = pool->free_list;
+        pool->free_list = node;
+    }
+    size_t nodes = count > pool->nodes_per_slab ? count : pool->nodes_per_slab;
+    size_t header = alignSize(sizeof(PoolSlab), 16);
+    PoolSlab *slab = (PoolSlab *)malloc(header + nodes * pool->node_size);
+    COUNT(COUNTER_MALLOCS, 1);
+    if (!slab) {
+        perror("Erro ao alocar bloco do pool de nós");
         exit(EXIT_FAILURE);
     }
-    newTask->completed = false; // Tarefa inicialmente não concluída
-    newTask->next = NULL;
-    return newTask;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->cursor = (char *)slab + header;
+    pool->limit = pool->cursor + nodes * pool->node_size;
+}
+
+// Devolve um nó ao pool
+void poolFree(NodePool *pool, void *node) {
+    *(void **)node = pool->free_list;
+    pool->free_list = node;
+}
+
+// Libera todos os blocos do pool de uma vez
+void destroyNodePool(NodePool *pool) {
+    PoolSlab *slab = pool->slabs;
+    while (slab != NULL) {
+        PoolSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    initNodePool(pool, pool->node_size);
+}
+
+// Inicializa uma arena de texto vazia
+void initTextArena(TextArena *arena) {
+    arena->chunks = NULL;
+    arena->cursor = NULL;
+    arena->limit = NULL;
+    for (int i = 0; i < TEXT_CLASS_COUNT; i++) {
+        arena->free_lists[i] = NULL;
+    }
+    arena->large = NULL;
+}
+
+// Reserva 'size' bytes na arena (size inclui o terminador)
+char *textAlloc(TextArena *arena, size_t size) {
+    size_t rounded = alignSize(size, TEXT_CLASS_SIZE);
+    size_t cls = rounded / TEXT_CLASS_SIZE - 1;
+    COUNT(COUNTER_TEXT_ALLOCS, 1);
+
+    if (cls >= TEXT_CLASS_COUNT) {
+        // Textos grandes: alocação individual, encadeada para o destroy
+        LargeText *block = (LargeText *)malloc(sizeof(LargeText) + size);
+        COUNT(COUNTER_MALLOCS, 1);
+        if (!block) {
+            perror("Erro ao alocar memória para a descrição da tarefa");
+            exit(EXIT_FAILURE);
+        }
+        block->prev = NULL;
+        block->next = arena->large;
+        if (arena->large != NULL) {
+            arena->large->prev = block;
+        }
+        arena->large = block;
+        return (char *)(block + 1);
+    }
+    if (arena->free_lists[cls] != NULL) {
+        char *text = (char *)arena->free_lists[cls];
+        arena->free_lists[cls] = *(void **)text;
+        return text;
+    }
+    if ((size_t)(arena->limit - arena->cursor) < rounded) {
+        size_t header = alignSize(sizeof(TextChunk), TEXT_CLASS_SIZE);
+        TextChunk *chunk = (TextChunk *)malloc(ALLOC_SLAB_BYTES);
+        COUNT(COUNTER_MALLOCS, 1);
+        if (!chunk) {
+            perror("Erro ao alocar pedaço da arena de texto");
+            exit(EXIT_FAILURE);
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->cursor = (char *)chunk + header;
+        arena->limit = (char *)chunk + ALLOC_SLAB_BYTES;
+    }
+    char *text = arena->cursor;
+    arena->cursor += rounded;
+    return text;
+}
+
+// Devolve à arena um bloco de 'size' bytes obtido com textAlloc
+void textFree(TextArena *arena, char *text, size_t size) {
+    size_t cls = alignSize(size, TEXT_CLASS_SIZE) / TEXT_CLASS_SIZE - 1;
+    if (cls >= TEXT_CLASS_COUNT) {
+        LargeText *block = (LargeText *)text - 1;
+        if (block->prev != NULL) {
+            block->prev->next = block->next;
+        } else {
+            arena->large = block->next;
+        }
+        if (block->next != NULL) {
+            block->next->prev = block->prev;
+        }
+        free(block);
+        return;
+    }
+    *(void **)text = arena->free_lists[cls];
+    arena->free_lists[cls] = text;
+}
+
+
+// Libera todos os pedaços e textos grandes da arena de uma vez
+void destroyTextArena(TextArena *arena) {
+    TextChunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        TextChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    LargeText *block = arena->large;
+    while (block != NULL) {
+        LargeText *next = block->next;
+        free(block);
+        block = next;
+    }
+    initTextArena(arena);
+}
+
+// --- Funções da Tabela de Descrições Internadas ---
+
+// Inicializa a tabela vazia (os baldes são alocados na primeira inserção)
+void initStringTable(StringTable *table) {
+    table->buckets = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    ReaderEpochs *epochs = &table->epochs;
+    atomic_init(&epochs->epoch, 1);
+    epochs->readers = NULL;
+    pthread_mutex_init(&epochs->lock, NULL);
+    epochs->retired = NULL;
+    epochs->retired_start = 0;
+    epochs->retired_count = 0;
+    epochs->retired_capacity = 0;
+    atomic_init(&epochs->retired_waiting, false);
+}
+
+// Hash FNV-1a de 32 bits
+uint32_t hashText(const char *text, size_t length) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)text[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Dobra o número de baldes e redistribui as entradas
+void stringTableGrow(StringTable *table) {
+    size_t new_capacity = table->capacity ? table->capacity * 2 : 64;
+    InternedText **buckets = (InternedText **)calloc(new_capacity, sizeof(InternedText *));
+    if (!buckets) {
+        perror("Erro ao alocar memória para a tabela de descrições");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        InternedText *entry = table->buckets[i];
+        while (entry != NULL) {
+            InternedText *next = entry->next;
+            size_t b = entry->hash & (new_capacity - 1);
+            entry->next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->capacity = new_capacity;
+}
+
+// Obtém a cópia única de um texto, criando-a na arena se ainda não existir
+// Cada chamada acrescenta uma referência; devolva-a com releaseInterned
+char *internText(StringTable *table, TextArena *arena, const char *src, size_t length) {
+    uint32_t hash = hashText(src, length);
+    if (table->capacity != 0) {
+        InternedText *entry = table->buckets[hash & (table->capacity - 1)];
+        while (entry != NULL) {
+            if (entry->hash == hash && entry->length == length && memcmp(entry->text, src, length) == 0) {
+                entry->refs++;
+                return entry->text;
+            }
+            entry = entry->next;
+        }
+    }
+    if (table->count >= table->capacity) {
+        stringTableGrow(table);
+    }
+    InternedText *entry = (InternedText *)textAlloc(arena, offsetof(InternedText, text) + length + 1);
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->length = (uint32_t)length;
+    memcpy(entry->text, src, length);
+    entry->text[length] = '\0';
+    size_t b = hash & (table->capacity - 1);
+    entry->next = table->buckets[b];
+    table->buckets[b] = entry;
+    table->count++;
+    return entry->text;
+}
+
+// Registra um leitor; daqui em diante, textos soltos esperam por ele
+// Pode ser chamada de qualquer thread
+void registerReader(StringTable *table, ReaderSlot *slot) {
+    atomic_init(&slot->epoch, 0);
+    pthread_mutex_lock(&table->epochs.lock);
+    slot->next = table->epochs.readers;
+    table->epochs.readers = slot;
+    pthread_mutex_unlock(&table->epochs.lock);
+}
+
+// Remove um leitor fora de uma leitura
+void unregisterReader(StringTable *table, ReaderSlot *slot) {
+    pthread_mutex_lock(&table->epochs.lock);
+    ReaderSlot **link = &table->epochs.readers;
+    while (*link != slot) {
+        link = &(*link)->next;
+    }
+    *link = slot->next;
+    pthread_mutex_unlock(&table->epochs.lock);
+}
+
+// Começa uma leitura: os textos vistos a partir daqui não voltam à arena até readerExit
+// Deve ser chamada com a lista travada para leitura
+void readerEnter(StringTable *table, ReaderSlot *slot) {
+    atomic_store(&slot->epoch, atomic_load(&table->epochs.epoch));
+}
+
+// Termina a leitura (a trava da lista já pode ter sido solta)
+void readerExit(ReaderSlot *slot) {
+    atomic_store(&slot->epoch, 0);
+}
+
+// Devolve à arena os textos aposentados que nenhum leitor em andamento pode ver
+void reclaimRetiredText(StringTable *table, TextArena *arena) {
+    ReaderEpochs *epochs = &table->epochs;
+    uint64_t oldest = UINT64_MAX; // Menor época fixada por um leitor em andamento
+    pthread_mutex_lock(&epochs->lock);
+    for (ReaderSlot *slot = epochs->readers; slot != NULL; slot = slot->next) {
+        uint64_t epoch = atomic_load(&slot->epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    pthread_mutex_unlock(&epochs->lock);
+    while (epochs->retired_start < epochs->retired_count && epochs->retired[epochs->retired_start].epoch < oldest) {
+        InternedText *entry = epochs->retired[epochs->retired_start++].entry;
+        textFree(arena, (char *)entry, offsetof(InternedText, text) + entry->length + 1);
+    }
+    if (epochs->retired_start == epochs->retired_count) {
+        epochs->retired_start = 0;
+        epochs->retired_count = 0;
+        atomic_store(&epochs->retired_waiting, false);
+    }
+}
+
+// Indica se há textos aposentados esperando por leitores
+// Pode ser chamada sem a trava da lista, depois de readerExit
+bool hasRetiredText(StringTable *table) {
+    return atomic_load(&table->epochs.retired_waiting);
+}
+
+// Solta uma referência a um texto internado, liberando-o na última
+// Com leitores registrados, o texto sai da tabela na hora mas só volta à
+// arena quando nenhuma leitura em andamento puder estar usando-o
+void releaseInterned(StringTable *table, TextArena *arena, char *text) {
+    InternedText *entry = (InternedText *)(text - offsetof(InternedText, text));
+    if (--entry->refs > 0) {
+        return;
+    }
+    InternedText **link = &table->buckets[entry->hash & (table->capacity - 1)];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    table->count--;
+    ReaderEpochs *epochs = &table->epochs;
+    pthread_mutex_lock(&epochs->lock); // Clientes se registram e saem a qualquer momento
+    bool no_readers = epochs->readers == NULL;
+    pthread_mutex_unlock(&epochs->lock);
+    if (no_readers && epochs->retired_count == 0) {
+        textFree(arena, (char *)entry, offsetof(InternedText, text) + entry->length + 1);
+        return;
+    }
+    if (epochs->retired_count == epochs->retired_capacity) {
+        if (epochs->retired_start > 0) {
+            // Reaproveita o espaço do início da fila antes de crescer
+            memmove(epochs->retired, epochs->retired + epochs->retired_start,
+                    (epochs->retired_count - epochs->retired_start) * sizeof(RetiredText));
+            epochs->retired_count -= epochs->retired_start;
+            epochs->retired_start = 0;
+        } else {
+            size_t new_capacity = epochs->retired_capacity ? epochs->retired_capacity * 2 : 64;
+            RetiredText *retired = (RetiredText *)realloc(epochs->retired, new_capacity * sizeof(RetiredText));
+            if (!retired) {
+                perror("Erro ao alocar memória para os textos aposentados");
+                exit(EXIT_FAILURE);
+            }
+            epochs->retired = retired;
+            epochs->retired_capacity = new_capacity;
+        }
+    }
+    epochs->retired[epochs->retired_count].entry = entry;
+    epochs->retired[epochs->retired_count].epoch = atomic_fetch_add(&epochs->epoch, 1);
+    epochs->retired_count++;
+    atomic_store(&epochs->retired_waiting, true);
+    reclaimRetiredText(table, arena);
+}
+
+// Libera os baldes da tabela (as entradas, inclusive as aposentadas, pertencem à arena de texto)
+void destroyStringTable(StringTable *table) {
+    free(table->buckets);
+    free(table->epochs.retired);
+    pthread_mutex_destroy(&table->epochs.lock);
+    initStringTable(table);
+}
+
+// --- Funções do Índice de Tarefas ---
+
+// Capacidade inicial do índice (potência de 2)
+#define TASK_INDEX_MIN_CAPACITY 16
+
+// Inicializa o índice vazio (a memória é alocada na primeira inserção)
+void initTaskIndex(TaskIndex *index) {
+    index->entries = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+// Calcula a posição inicial de um ID no índice (hash multiplicativo de Fibonacci)
+size_t taskIndexSlot(int id, size_t capacity) {
+    uint32_t h = (uint32_t)id * 2654435761u;
+    return (size_t)(h ^ (h >> 16)) & (capacity - 1);
+}
+
+// Insere uma entrada sem verificar a carga (usado também no redimensionamento)
+void taskIndexPlace(TaskIndex *index, int id, Task *task) {
+    size_t mask = index->capacity - 1;
+    size_t i = taskIndexSlot(id, index->capacity);
+    while (index->entries[i].task != NULL) {
+        if (index->entries[i].id == id) {
+            index->entries[i].task = task; // ID já presente: atualiza o ponteiro
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    index->entries[i].id = id;
+    index->entries[i].task = task;
+    index->count++;
+}
+
+// Dobra a capacidade do índice e reinsere todas as entradas
+void taskIndexGrow(TaskIndex *index) {
+    size_t old_capacity = index->capacity;
+    TaskIndexEntry *old_entries = index->entries;
+    size_t new_capacity = old_capacity ? old_capacity * 2 : TASK_INDEX_MIN_CAPACITY;
+
+    index->entries = (TaskIndexEntry *)calloc(new_capacity, sizeof(TaskIndexEntry));
+    if (!index->entries) {
+        perror("Erro ao alocar memória para o índice de tarefas");
+        exit(EXIT_FAILURE);
+    }
+    index->capacity = new_capacity;
+    index->count = 0;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].task != NULL) {
+            taskIndexPlace(index, old_entries[i].id, old_entries[i].task);
+        }
+    }
+    free(old_entries);
+}
+
+// Garante capacidade para 'count' entradas sem redimensionar (carga em lote)
+void taskIndexReserve(TaskIndex *index, size_t count) {
+    while (count * 10 > index->capacity * 7) {
+        taskIndexGrow(index);
+    }
+}
+
+// Associa um ID a uma tarefa no índice
+void taskIndexInsert(TaskIndex *index, int id, Task *task) {
+    // Mantém a ocupação abaixo de 70% para que as sondagens continuem curtas
+    if ((index->count + 1) * 10 > index->capacity * 7) {
+        taskIndexGrow(index);
+    }
+    taskIndexPlace(index, id, task);
+}
+
+// Busca a tarefa associada a um ID (NULL se não existir)
+Task *taskIndexFind(const TaskIndex *index, int id) {
+    if (index->capacity == 0) {
+        return NULL;
+    }
+    size_t mask = index->capacity - 1;
+    size_t i = taskIndexSlot(id, index->capacity);
+    uint64_t probes = 1;
+    while (index->entries[i].task != NULL) {
+        if (index->entries[i].id == id) {
+            COUNT(COUNTER_PROBES, probes);
+            return index->entries[i].task;
+        }
+        i = (i + 1) & mask;
+        probes++;
+    }
+    COUNT(COUNTER_PROBES, probes);
+    return NULL;
+}
+
+// Remove um ID do índice
+// Usa remoção com deslocamento para trás, evitando marcadores de posição apagada
+void taskIndexRemove(TaskIndex *index, int id) {
+    if (index->capacity == 0) {
+        return;
+    }
+    size_t mask = index->capacity - 1;
+    size_t i = taskIndexSlot(id, index->capacity);
+    while (index->entries[i].task != NULL && index->entries[i].id != id) {
+        i = (i + 1) & mask;
+    }
+    if (index->entries[i].task == NULL) {
+        return; // ID não está no índice
+    }
+
+    // Puxa para a posição liberada as entradas seguintes que pertencem a ela
+    size_t hole = i;
+    size_t j = (i + 1) & mask;
+    while (index->entries[j].task != NULL) {
+        size_t home = taskIndexSlot(index->entries[j].id, index->capacity);
+        // A entrada em j pode ocupar o buraco se sua posição inicial não estiver
+        // no intervalo circular (hole, j]
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            index->entries[hole] = index->entries[j];
+            hole = j;
+        }
+        j = (j + 1) & mask;
+    }
+    index->entries[hole].task = NULL;
+    index->count--;
+}
+
+// Libera a memória do índice
+void destroyTaskIndex(TaskIndex *index) {
+    free(index->entries);
+    initTaskIndex(index);
+}
+
+// --- Funções do Índice Ordenado (Árvore B+) ---
+
+// Altura máxima da árvore (cada divisão deixa pelo menos metade dos filhos
+// em cada lado, então 2^31 IDs não passam de 9 níveis)
+#define ORDER_MAX_DEPTH 16
+
+// Inicializa o índice ordenado vazio
+void initOrderedIndex(OrderedIndex *order) {
+    order->root = NULL;
+    order->first = NULL;
+    initNodePool(&order->nodes, sizeof(OrderNode));
+}
+
+// Obtém um nó vazio do pool
+OrderNode *orderNewNode(OrderedIndex *order, bool leaf) {
+    OrderNode *node = (OrderNode *)poolAlloc(&order->nodes);
+    node->count = 0;
+    node->leaf = leaf;
+    node->prev = NULL;
+    node->next = NULL;
+    return node;
+}
+
+// Primeira posição de 'node' cuja chave é >= id (busca binária)
+int orderLowerBound(const OrderNode *node, int id) {
+    int low = 0, high = node->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (node->keys[mid] < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Filho de um nó interno que pode conter 'id'
+int orderChildFor(const OrderNode *node, int id) {
+    int i = orderLowerBound(node, id);
+    return (i < node->count && node->keys[i] == id) ? i + 1 : i;
+}
+
+// Desce da raiz até a folha que pode conter 'id', anotando o caminho
+// Retorna a profundidade da folha
+int orderDescend(const OrderedIndex *order, int id, OrderNode **path, int *slots) {
+    int depth = 0;
+    OrderNode *node = order->root;
+    while (!node->leaf) {
+        int child = orderChildFor(node, id);
+        path[depth] = node;
+        slots[depth] = child;
+        depth++;
+        node = node->children[child];
+    }
+    path[depth] = node;
+    return depth;
+}
+
+// Insere (ou atualiza) a tarefa de um ID
+// Nós cheios são divididos ao meio; quando a inserção é no fim do nó (IDs
+// crescentes, o caso comum), o nó cheio fica como está e o novo começa vazio,
+// então adições em sequência deixam as folhas completamente ocupadas
+void orderInsert(OrderedIndex *order, int id, Task *task) {
+    if (order->root == NULL) {
+        order->root = order->first = orderNewNode(order, true);
+    }
+    OrderNode *path[ORDER_MAX_DEPTH];
+    int slots[ORDER_MAX_DEPTH];
+    int depth = orderDescend(order, id, path, slots);
+
+    OrderNode *leaf = path[depth];
+    int pos = orderLowerBound(leaf, id);
+    if (pos < leaf->count && leaf->keys[pos] == id) {
+        leaf->tasks[pos] = task; // ID já presente: atualiza o ponteiro
+        return;
+    }
+    if (leaf->count < ORDER_NODE_KEYS) {
+        memmove(&leaf->keys[pos + 1], &leaf->keys[pos], (size_t)(leaf->count - pos) * sizeof(int));
+        memmove(&leaf->tasks[pos + 1], &leaf->tasks[pos], (size_t)(leaf->count - pos) * sizeof(Task *));
+        leaf->keys[pos] = id;
+        leaf->tasks[pos] = task;
+        leaf->count++;
+        return;
+    }
+
+    // Folha cheia: divide, encadeando a nova folha à direita
+    OrderNode *right = orderNewNode(order, true);
+    int split = pos == ORDER_NODE_KEYS ? ORDER_NODE_KEYS : ORDER_NODE_KEYS / 2;
+    right->count = ORDER_NODE_KEYS - split;
+    memcpy(right->keys, &leaf->keys[split], (size_t)right->count * sizeof(int));
+    memcpy(right->tasks, &leaf->tasks[split], (size_t)right->count * sizeof(Task *));
+    leaf->count = split;
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next != NULL) {
+        leaf->next->prev = right;
+    }
+    leaf->next = right;
+    OrderNode *target = pos < split ? leaf : right;
+    int target_pos = pos < split ? pos : pos - split;
+    memmove(&target->keys[target_pos + 1], &target->keys[target_pos], (size_t)(target->count - target_pos) * sizeof(int));
+    memmove(&target->tasks[target_pos + 1], &target->tasks[target_pos], (size_t)(target->count - target_pos) * sizeof(Task *));
+    target->keys[target_pos] = id;
+    target->tasks[target_pos] = task;
+    target->count++;
+
+    // Sobe o separador, dividindo os nós internos que estiverem cheios
+    int separator = right->keys[0];
+    OrderNode *child = right;
+    while (depth > 0) {
+        depth--;
+        OrderNode *node = path[depth];
+        int at = slots[depth]; // O novo filho entra em children[at + 1]
+        if (node->count < ORDER_NODE_KEYS) {
+            memmove(&node->keys[at + 1], &node->keys[at], (size_t)(node->count - at) * sizeof(int));
+            memmove(&node->children[at + 2], &node->children[at + 1], (size_t)(node->count - at) * sizeof(OrderNode *));
+            node->keys[at] = separator;
+            node->children[at + 1] = child;
+            node->count++;
+            return;
+        }
+        // Monta a sequência completa (uma chave e um filho a mais) e a reparte
+        int keys[ORDER_NODE_KEYS + 1];
+        OrderNode *children[ORDER_NODE_KEYS + 2];
+        memcpy(keys, node->keys, (size_t)at * sizeof(int));
+        keys[at] = separator;
+        memcpy(&keys[at + 1], &node->keys[at], (size_t)(ORDER_NODE_KEYS - at) * sizeof(int));
+        memcpy(children, node->children, (size_t)(at + 1) * sizeof(OrderNode *));
+        children[at + 1] = child;
+        memcpy(&children[at + 2], &node->children[at + 1], (size_t)(ORDER_NODE_KEYS - at) * sizeof(OrderNode *));
+
+        int middle = at == ORDER_NODE_KEYS ? ORDER_NODE_KEYS : ORDER_NODE_KEYS / 2;
+        OrderNode *sibling = orderNewNode(order, false);
+        node->count = middle;
+        memcpy(node->keys, keys, (size_t)middle * sizeof(int));
+        memcpy(node->children, children, (size_t)(middle + 1) * sizeof(OrderNode *));
+        sibling->count = ORDER_NODE_KEYS - middle;
+        memcpy(sibling->keys, &keys[middle + 1], (size_t)sibling->count * sizeof(int));
+        memcpy(sibling->children, &children[middle + 1], (size_t)(sibling->count + 1) * sizeof(OrderNode *));
+        separator = keys[middle];
+        child = sibling;
+    }
+
+    // A raiz foi dividida: a árvore cresce um nível
+    OrderNode *root = orderNewNode(order, false);
+    root->count = 1;
+    root->keys[0] = separator;
+    root->children[0] = order->root;
+    root->children[1] = child;
+    order->root = root;
+}
+
+// Remove um ID do índice ordenado (sem efeito se ausente)
+// Nós não são redistribuídos; apenas os que ficam vazios saem da árvore
+void orderRemove(OrderedIndex *order, int id) {
+    if (order->root == NULL) {
+        return;
+    }
+    OrderNode *path[ORDER_MAX_DEPTH];
+    int slots[ORDER_MAX_DEPTH];
+    int depth = orderDescend(order, id, path, slots);
+
+    OrderNode *leaf = path[depth];
+    int pos = orderLowerBound(leaf, id);
+    if (pos == leaf->count || leaf->keys[pos] != id) {
+        return;
+    }
+    leaf->count--;
+    memmove(&leaf->keys[pos], &leaf->keys[pos + 1], (size_t)(leaf->count - pos) * sizeof(int));
+    memmove(&leaf->tasks[pos], &leaf->tasks[pos + 1], (size_t)(leaf->count - pos) * sizeof(Task *));
+    if (leaf->count > 0 || depth == 0) {
+        return;
+    }
+
+    // Folha vazia: sai da lista de folhas e do pai
+    if (leaf->prev == NULL) {
+        order->first = leaf->next;
+    } else {
+        leaf->prev->next = leaf->next;
+    }
+    if (leaf->next != NULL) {
+        leaf->next->prev = leaf->prev;
+    }
+    poolFree(&order->nodes, leaf);
+    while (depth > 0) {
+        depth--;
+        OrderNode *node = path[depth];
+        int at = slots[depth];
+        if (node->count == 0) {
+            // Era o único filho: o nó interno também fica vazio
+            poolFree(&order->nodes, node);
+            continue;
+        }
+        // Remove o filho e um separador vizinho
+        int key = at > 0 ? at - 1 : 0;
+        memmove(&node->keys[key], &node->keys[key + 1], (size_t)(node->count - key - 1) * sizeof(int));
+        memmove(&node->children[at], &node->children[at + 1], (size_t)(node->count - at) * sizeof(OrderNode *));
+        node->count--;
+        break;
+    }
+    // A raiz com um único filho é descartada
+    while (!order->root->leaf && order->root->count == 0) {
+        OrderNode *root = order->root;
+        order->root = root->children[0];
+        poolFree(&order->nodes, root);
+    }
+}
+
+// Posiciona o cursor no primeiro ID >= 'id', em O(log n)
+OrderCursor orderSeek(const OrderedIndex *order, int id) {
+    OrderCursor cursor = { NULL, 0 };
+    if (order->root == NULL) {
+        return cursor;
+    }
+    OrderNode *node = order->root;
+    while (!node->leaf) {
+        node = node->children[orderChildFor(node, id)];
+    }
+    cursor.leaf = node;
+    cursor.pos = orderLowerBound(node, id);
+    if (cursor.pos == node->count) {
+        cursor.leaf = node->next;
+        cursor.pos = 0;
+    }
+    return cursor;
+}
+
+// Cursor na primeira tarefa em ordem de ID
+OrderCursor orderFirst(const OrderedIndex *order) {
+    OrderCursor cursor = { order->first, 0 };
+    if (cursor.leaf != NULL && cursor.leaf->count == 0) {
+        cursor.leaf = NULL; // Árvore vazia (só a folha raiz)
+    }
+    return cursor;
+}
+
+// Tarefa na posição do cursor e avanço para a próxima (NULL no fim)
+Task *orderNext(OrderCursor *cursor) {
+    if (cursor->leaf == NULL) {
+        return NULL;
+    }
+    Task *task = cursor->leaf->tasks[cursor->pos];
+    if (++cursor->pos == cursor->leaf->count) {
+        cursor->leaf = cursor->leaf->next;
+        cursor->pos = 0;
+    }
+    return task;
+}
+
+// Libera todos os nós do índice ordenado
+void destroyOrderedIndex(OrderedIndex *order) {
+    destroyNodePool(&order->nodes);
+    initOrderedIndex(order);
+}
+
+// --- Funções do Índice de Busca (Índice Invertido) ---
+
+// Tamanho máximo de um termo; palavras maiores são truncadas (na indexação e na busca)
+#define SEARCH_TERM_MAX 64
+
+// Inicializa o índice de busca vazio e ainda não construído
+void initSearchIndex(SearchIndex *search) {
+    search->buckets = NULL;
+    search->capacity = 0;
+    search->count = 0;
+    search->built = false;
+}
+
+// Lê o próximo termo de '*text': uma sequência de letras, dígitos ou bytes
+// não ASCII (acentos em UTF-8), com as letras ASCII em minúsculas
+// Retorna o comprimento gravado em 'term' (0 quando o texto acaba)
+size_t nextSearchTerm(const char **text, char *term) {
+    const unsigned char *p = (const unsigned char *)*text;
+    while (*p != '\0' && !(isalnum(*p) || *p >= 0x80)) {
+        p++;
+    }
+    size_t length = 0;
+    while (*p != '\0' && (isalnum(*p) || *p >= 0x80)) {
+        if (length < SEARCH_TERM_MAX) {
+            term[length++] = (char)tolower(*p);
+        }
+        p++;
+    }
+    *text = (const char *)p;
+    return length;
+}
+
+// Busca um termo; 'link' recebe o ponteiro que aponta para ele (ou o fim do balde)
+SearchTerm *searchFindTerm(const SearchIndex *search, const char *term, size_t length,
+                           uint32_t hash, SearchTerm ***link) {
+    if (search->capacity == 0) {
+        return NULL;
+    }
+    SearchTerm **at = &search->buckets[hash & (search->capacity - 1)];
+    while (*at != NULL) {
+        SearchTerm *entry = *at;
+        if (entry->hash == hash && entry->length == length && memcmp(entry->text, term, length) == 0) {
+            break;
+        }
+        at = &entry->next;
+    }
+    if (link != NULL) {
+        *link = at;
+    }
+    return *at;
+}
+
+// Dobra o número de baldes e redistribui os termos
+void searchIndexGrow(SearchIndex *search) {
+    size_t new_capacity = search->capacity ? search->capacity * 2 : 256;
+    SearchTerm **buckets = (SearchTerm **)calloc(new_capacity, sizeof(SearchTerm *));
+    if (!buckets) {
+        perror("Erro ao alocar memória para o índice de busca");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < search->capacity; i++) {
+        SearchTerm *entry = search->buckets[i];
+        while (entry != NULL) {
+            SearchTerm *next = entry->next;
+            size_t b = entry->hash & (new_capacity - 1);
+            entry->next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+    free(search->buckets);
+    search->buckets = buckets;
+    search->capacity = new_capacity;
+}
+
+// Primeira posição de 'ids' com valor >= id (busca binária)
+size_t postingsLowerBound(const int *ids, size_t count, int id) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (ids[mid] < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Acrescenta um ID aos postings de um termo, criando o termo na arena se preciso
+// IDs novos costumam ser os maiores, então a inserção quase sempre é no fim
+void searchAddPosting(SearchIndex *search, TextArena *arena, const char *term, size_t length, int id) {
+    uint32_t hash = hashText(term, length);
+    SearchTerm *entry = searchFindTerm(search, term, length, hash, NULL);
+    if (entry == NULL) {
+        if (search->count >= search->capacity) {
+            searchIndexGrow(search);
+        }
+        entry = (SearchTerm *)textAlloc(arena, offsetof(SearchTerm, text) + length);
+        entry->hash = hash;
+        entry->length = (uint32_t)length;
+        entry->ids = NULL;
+        entry->count = 0;
+        entry->capacity = 0;
+        memcpy(entry->text, term, length);
+        size_t b = hash & (search->capacity - 1);
+        entry->next = search->buckets[b];
+        search->buckets[b] = entry;
+        search->count++;
+    }
+    size_t pos = entry->count > 0 && entry->ids[entry->count - 1] < id
+                     ? entry->count
+                     : postingsLowerBound(entry->ids, entry->count, id);
+    if (pos < entry->count && entry->ids[pos] == id) {
+        return; // Termo repetido na mesma descrição
+    }
+    if (entry->count == entry->capacity) {
+        size_t new_capacity = entry->capacity ? entry->capacity * 2 : 4;
+        int *ids = (int *)realloc(entry->ids, new_capacity * sizeof(int));
+        if (!ids) {
+            perror("Erro ao alocar memória para o índice de busca");
+            exit(EXIT_FAILURE);
+        }
+        entry->ids = ids;
+        entry->capacity = new_capacity;
+    }
+    memmove(&entry->ids[pos + 1], &entry->ids[pos], (entry->count - pos) * sizeof(int));
+    entry->ids[pos] = id;
+    entry->count++;
+}
+
+// Retira um ID dos postings de um termo; o termo sai do índice ao ficar sem IDs
+void searchRemovePosting(SearchIndex *search, TextArena *arena, const char *term, size_t length, int id) {
+    SearchTerm **link;
+    SearchTerm *entry = searchFindTerm(search, term, length, hashText(term, length), &link);
+    if (entry == NULL) {
+        return;
+    }
+    size_t pos = postingsLowerBound(entry->ids, entry->count, id);
+    if (pos == entry->count || entry->ids[pos] != id) {
+        return; // Termo repetido, já retirado
+    }
+    entry->count--;
+    memmove(&entry->ids[pos], &entry->ids[pos + 1], (entry->count - pos) * sizeof(int));
+    if (entry->count == 0) {
+        *link = entry->next;
+        search->count--;
+        free(entry->ids);
+        textFree(arena, (char *)entry, offsetof(SearchTerm, text) + entry->length);
+    }
+}
+
+// Indexa (add=true) ou desindexa as palavras da descrição de uma tarefa
+void searchIndexTask(SearchIndex *search, TextArena *arena, const Task *task, bool add) {
+    if (!search->built) {
+        return;
+    }
+    char term[SEARCH_TERM_MAX];
+    const char *p = task->description;
+    size_t length;
+    while ((length = nextSearchTerm(&p, term)) > 0) {
+        if (add) {
+            searchAddPosting(search, arena, term, length, task->id);
+        } else {
+            searchRemovePosting(search, arena, term, length, task->id);
+        }
+    }
+}
+
+// Libera os postings e os baldes (os termos pertencem à arena de texto)
+void destroySearchIndex(SearchIndex *search) {
+    for (size_t i = 0; i < search->capacity; i++) {
+        for (SearchTerm *entry = search->buckets[i]; entry != NULL; entry = entry->next) {
+            free(entry->ids);
+        }
+    }
+    free(search->buckets);
+    initSearchIndex(search);
+}
+
+// --- Funções da Busca por Trecho (Pacote de Descrições) ---
+
+// Inicializa o pacote vazio e inválido (montado na primeira busca)
+void initDescriptionPack(DescriptionPack *pack) {
+    pack->text = NULL;
+    pack->used = 0;
+    pack->capacity = 0;
+    pack->entries = NULL;
+    pack->count = 0;
+    pack->entry_capacity = 0;
+    pack->valid = false;
+}
+
+// Acrescenta a descrição de uma tarefa ao fim do pacote
+void packAppend(DescriptionPack *pack, const Task *task) {
+    size_t length = strlen(task->description) + 1;
+    if (pack->used + length > pack->capacity) {
+        size_t new_capacity = pack->capacity ? pack->capacity : 4096;
+        while (pack->used + length > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *text = (char *)realloc(pack->text, new_capacity);
+        if (!text) {
+            perror("Erro ao alocar memória para o pacote de descrições");
+            exit(EXIT_FAILURE);
+        }
+        pack->text = text;
+        pack->capacity = new_capacity;
+    }
+    if (pack->count == pack->entry_capacity) {
+        size_t new_capacity = pack->entry_capacity ? pack->entry_capacity * 2 : 256;
+        PackEntry *entries = (PackEntry *)realloc(pack->entries, new_capacity * sizeof(PackEntry));
+        if (!entries) {
+            perror("Erro ao alocar memória para o pacote de descrições");
+            exit(EXIT_FAILURE);
+        }
+        pack->entries = entries;
+        pack->entry_capacity = new_capacity;
+    }
+    pack->entries[pack->count].id = task->id;
+    pack->entries[pack->count].offset = pack->used;
+    pack->count++;
+    memcpy(pack->text + pack->used, task->description, length);
+    pack->used += length;
+}
+
+// Procura 'needle' (comprimento 'length' >= 1) em text[start, size), em C puro
+// Retorna a posição da ocorrência ou SIZE_MAX
+size_t packScanScalar(const char *text, size_t size, const char *needle, size_t length, size_t start) {
+    const char *p = text + start;
+    const char *end = text + size;
+    while ((size_t)(end - p) >= length) {
+        p = (const char *)memchr(p, needle[0], (size_t)(end - p) - length + 1);
+        if (p == NULL) {
+            break;
+        }
+        if (memcmp(p + 1, needle + 1, length - 1) == 0) {
+            return (size_t)(p - text);
+        }
+        p++;
+    }
+    return SIZE_MAX;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Versões vetoriais: comparam 16/32 posições de uma vez com o primeiro e com o
+// último byte do trecho e só conferem com memcmp as posições em que os dois batem
+// Exigem 'length' >= 2; as leituras nunca passam de text[size - 1]
+
+__attribute__((target("sse2")))
+size_t packScanSse2(const char *text, size_t size, const char *needle, size_t length, size_t start) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[length - 1]);
+    size_t i = start;
+    for (; i + length - 1 + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(text + i + length - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(text + i + bit + 1, needle + 1, length - 2) == 0) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return packScanScalar(text, size, needle, length, i);
+}
+
+__attribute__((target("avx2")))
+size_t packScanAvx2(const char *text, size_t size, const char *needle, size_t length, size_t start) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[length - 1]);
+    size_t i = start;
+    for (; i + length - 1 + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(text + i + length - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(text + i + bit + 1, needle + 1, length - 2) == 0) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return packScanScalar(text, size, needle, length, i);
+}
+#endif
+
+// Função de varredura escolhida conforme o processador (AVX2, SSE2 ou C puro)
+typedef size_t (*PackScanFn)(const char *text, size_t size, const char *needle, size_t length, size_t start);
+
+PackScanFn selectPackScan(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return packScanAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return packScanSse2;
+    }
+#endif
+    return packScanScalar;
+}
+
+// Libera a memória do pacote
+void destroyDescriptionPack(DescriptionPack *pack) {
+    free(pack->text);
+    free(pack->entries);
+    initDescriptionPack(pack);
+}
+
+// --- Funções das Colunas (Layout SoA) ---
+
+// Inicializa as colunas vazias
+void initTaskColumns(TaskColumns *columns) {
+    columns->ids = NULL;
+    columns->descriptions = NULL;
+    columns->completed = NULL;
+    columns->live = NULL;
+    columns->count = 0;
+    columns->capacity = 0;
+    columns->free_slots = NULL;
+    columns->free_count = 0;
+}
+
+// Dobra a capacidade de todas as colunas
+void columnsGrow(TaskColumns *columns) {
+    size_t new_capacity = columns->capacity ? columns->capacity * 2 : 1024;
+    size_t words = columns->capacity / 64;
+    size_t new_words = new_capacity / 64;
+    int *ids = (int *)realloc(columns->ids, new_capacity * sizeof(int));
+    const char **descriptions = (const char **)realloc((void *)columns->descriptions, new_capacity * sizeof(char *));
+    uint64_t *completed = (uint64_t *)realloc(columns->completed, new_words * sizeof(uint64_t));
+    uint64_t *live = (uint64_t *)realloc(columns->live, new_words * sizeof(uint64_t));
+    uint32_t *free_slots = (uint32_t *)realloc(columns->free_slots, new_capacity * sizeof(uint32_t));
+    if (!ids || !descriptions || !completed || !live || !free_slots) {
+        perror("Erro ao alocar memória para as colunas da lista");
+        exit(EXIT_FAILURE);
+    }
+    memset(completed + words, 0, (new_words - words) * sizeof(uint64_t));
+    memset(live + words, 0, (new_words - words) * sizeof(uint64_t));
+    columns->ids = ids;
+    columns->descriptions = descriptions;
+    columns->completed = completed;
+    columns->live = live;
+    columns->free_slots = free_slots;
+    columns->capacity = new_capacity;
+}
+
+// Dá a uma tarefa que entra na lista uma posição nas colunas (reaproveitando lápides)
+void columnsAdd(TaskColumns *columns, Task *task) {
+    size_t slot;
+    if (columns->free_count > 0) {
+        slot = columns->free_slots[--columns->free_count];
+    } else {
+        if (columns->count == columns->capacity) {
+            columnsGrow(columns);
+        }
+        slot = columns->count++;
+    }
+    uint64_t bit = 1ull << (slot % 64);
+    columns->ids[slot] = task->id;
+    columns->descriptions[slot] = task->description;
+    columns->live[slot / 64] |= bit;
+    if (task->completed) {
+        columns->completed[slot / 64] |= bit;
+    } else {
+        columns->completed[slot / 64] &= ~bit;
+    }
+    task->slot = (uint32_t)slot;
+}
+
+// Transforma em lápide a posição de uma tarefa que sai da lista
+void columnsRemove(TaskColumns *columns, const Task *task) {
+    columns->live[task->slot / 64] &= ~(1ull << (task->slot % 64));
+    columns->free_slots[columns->free_count++] = task->slot;
+}
+
+// Atualiza o estado de uma tarefa nas colunas
+void columnsSetCompleted(TaskColumns *columns, const Task *task) {
+    uint64_t bit = 1ull << (task->slot % 64);
+    if (task->completed) {
+        columns->completed[task->slot / 64] |= bit;
+    } else {
+        columns->completed[task->slot / 64] &= ~bit;
+    }
+}
+
+// Palavra 'w' do bitset das posições ocupadas que passam no filtro de estado
+uint64_t columnsStateWord(const TaskColumns *columns, size_t w, StateFilter state) {
+    uint64_t bits = columns->live[w];
+    if (state == FILTER_PENDING) {
+        bits &= ~columns->completed[w];
+    } else if (state == FILTER_COMPLETED) {
+        bits &= columns->completed[w];
+    }
+    return bits;
+}
+
+// Libera a memória das colunas
+void destroyTaskColumns(TaskColumns *columns) {
+    free(columns->ids);
+    free((void *)columns->descriptions);
+    free(columns->completed);
+    free(columns->live);
+    free(columns->free_slots);
+    initTaskColumns(columns);
+}
+
+// --- Funções do Mapa de Conclusão (Bitmap por ID) ---
+
+// Inicializa o mapa vazio
+void initCompletionMap(CompletionMap *map) {
+    map->present = NULL;
+    map->completed = NULL;
+    map->words = 0;
+    map->by_slot = false;
+}
+
+// Garante que o mapa cubra a posição 'key'
+void completionReserve(CompletionMap *map, size_t key) {
+    size_t needed = key / 64 + 1;
+    if (needed <= map->words) {
+        return;
+    }
+    size_t words = map->words ? map->words : 16;
+    while (words < needed) {
+        words *= 2;
+    }
+    uint64_t *present = (uint64_t *)realloc(map->present, words * sizeof(uint64_t));
+    uint64_t *completed = (uint64_t *)realloc(map->completed, words * sizeof(uint64_t));
+    if (!present || !completed) {
+        perror("Erro ao alocar memória para o mapa de conclusão");
+        exit(EXIT_FAILURE);
+    }
+    memset(present + map->words, 0, (words - map->words) * sizeof(uint64_t));
+    memset(completed + map->words, 0, (words - map->words) * sizeof(uint64_t));
+    map->present = present;
+    map->completed = completed;
+    map->words = words;
+}
+
+// Registra no mapa o estado de uma tarefa que está na lista (present=true)
+// ou que acabou de sair dela
+void completionSet(CompletionMap *map, const Task *task, bool present) {
+    if (!map->by_slot && task->id < 0) {
+        return; // IDs negativos não aparecem no mapa
+    }
+    size_t key = map->by_slot ? task->slot : (size_t)task->id;
+    completionReserve(map, key);
+    size_t w = key / 64;
+    uint64_t bit = 1ull << (key % 64);
+    if (present) {
+        map->present[w] |= bit;
+    } else {
+        map->present[w] &= ~bit;
+    }
+    if (present && task->completed) {
+        map->completed[w] |= bit;
+    } else {
+        map->completed[w] &= ~bit;
+    }
+}
+
+// Máscara dos bits da palavra 'w' que caem no intervalo de IDs [first, last]
+uint64_t completionRangeMask(size_t w, size_t first, size_t last) {
+    uint64_t mask = ~0ull;
+    if (w == first / 64) {
+        mask &= ~0ull << (first % 64);
+    }
+    if (w == last / 64) {
+        mask &= ~0ull >> (63 - last % 64);
+    }
+    return mask;
+}
+
+// Conta os bits 1 das posições [first, last] de um bitset
+// O compilador gera também uma versão com a instrução POPCNT, escolhida na
+// carga do programa quando o processador a tem
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target_clones("popcnt", "default")))
+#endif
+size_t countBitsRange(const uint64_t *words, size_t first, size_t last) {
+    size_t first_word = first / 64;
+    size_t last_word = last / 64;
+    size_t total = (size_t)__builtin_popcountll(words[first_word] & completionRangeMask(first_word, first, last));
+    if (last_word == first_word) {
+        return total;
+    }
+    for (size_t w = first_word + 1; w < last_word; w++) {
+        total += (size_t)__builtin_popcountll(words[w]);
+    }
+    return total + (size_t)__builtin_popcountll(words[last_word] & completionRangeMask(last_word, first, last));
+}
+
+// Conta as tarefas presentes e as concluídas com IDs em [first, last]
+void completionCount(const CompletionMap *map, int first, int last, size_t *present, size_t *completed) {
+    *present = 0;
+    *completed = 0;
+    if (first < 0) {
+        first = 0;
+    }
+    if (last < first || (size_t)first >= map->words * 64) {
+        return;
+    }
+    size_t high = (size_t)last < map->words * 64 ? (size_t)last : map->words * 64 - 1;
+    *present = countBitsRange(map->present, (size_t)first, high);
+    *completed = countBitsRange(map->completed, (size_t)first, high);
+}
+
+// Bits da palavra 'w' do mapa com as tarefas presentes no estado pedido
+uint64_t completionStateWord(const CompletionMap *map, size_t w, StateFilter state) {
+    uint64_t bits = map->present[w];
+    if (state == FILTER_PENDING) {
+        bits &= ~map->completed[w];
+    } else if (state == FILTER_COMPLETED) {
+        bits &= map->completed[w];
+    }
+    return bits;
+}
+
+// Libera a memória do mapa
+void destroyCompletionMap(CompletionMap *map) {
+    free(map->present);
+    free(map->completed);
+    initCompletionMap(map);
+}
+
+// Número de palavras do bitset de um conjunto com IDs em [first, last]
+size_t idSetWords(int first, int last) {
+    return (size_t)last / 64 - (size_t)first / 64 + 1;
+}
+
+// Cria um conjunto vazio capaz de guardar os IDs de [first, last] (first >= 0)
+void initIdSet(IdSet *set, int first, int last) {
+    set->first = first;
+    set->last = last;
+    set->bits = (uint64_t *)calloc(idSetWords(first, last), sizeof(uint64_t));
+    if (!set->bits) {
+        perror("Erro ao alocar memória para o conjunto de IDs");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Acrescenta ao conjunto todos os IDs de [low, high], palavra a palavra
+void idSetAddRange(IdSet *set, int low, int high) {
+    size_t base = (size_t)set->first / 64;
+    for (size_t w = (size_t)low / 64; w <= (size_t)high / 64; w++) {
+        set->bits[w - base] |= completionRangeMask(w, (size_t)low, (size_t)high);
+    }
+}
+
+// Começa uma varredura dos IDs marcados em 'bits' (ver IdSet)
+void initIdSetCursor(IdSetCursor *cursor, int first, int last, const uint64_t *bits) {
+    cursor->bits = bits;
+    cursor->base = (size_t)first / 64;
+    cursor->words = idSetWords(first, last);
+    cursor->k = 0;
+    cursor->word = cursor->words > 0 ? bits[0] : 0;
+}
+
+// Próximo ID do conjunto; retorna false no fim
+bool idSetNext(IdSetCursor *cursor, int *id) {
+    while (cursor->word == 0) {
+        if (++cursor->k >= cursor->words) {
+            return false;
+        }
+        cursor->word = cursor->bits[cursor->k];
+    }
+    *id = (int)((cursor->base + cursor->k) * 64 + (size_t)__builtin_ctzll(cursor->word));
+    cursor->word &= cursor->word - 1;
+    return true;
+}
+
+// Libera o bitset de um conjunto
+void destroyIdSet(IdSet *set) {
+    free(set->bits);
+    set->bits = NULL;
+}
+
+// --- Funções das Posições Livres (modo --dense-ids) ---
+
+// Inicializa o conjunto vazio
+void initFreeSlots(FreeSlots *slots) {
+    slots->bits = NULL;
+    slots->words = 0;
+    slots->hint = 0;
+    slots->count = 0;
+    slots->used = 0;
+}
+
+// Indica se a posição está livre
+bool freeSlotsContains(const FreeSlots *slots, uint32_t slot) {
+    size_t w = slot / 64;
+    return w < slots->words && (slots->bits[w] >> (slot % 64) & 1) != 0;
+}
+
+// Marca uma posição como livre
+void freeSlotsAdd(FreeSlots *slots, uint32_t slot) {
+    size_t w = slot / 64;
+    if (w >= slots->words) {
+        size_t words = slots->words ? slots->words : 16;
+        while (words <= w) {
+            words *= 2;
+        }
+        uint64_t *bits = (uint64_t *)realloc(slots->bits, words * sizeof(uint64_t));
+        if (!bits) {
+            perror("Erro ao alocar memória para as posições livres");
+            exit(EXIT_FAILURE);
+        }
+        memset(bits + slots->words, 0, (words - slots->words) * sizeof(uint64_t));
+        slots->bits = bits;
+        slots->words = words;
+    }
+    slots->bits[w] |= 1ull << (slot % 64);
+    slots->count++;
+    if (w < slots->hint) {
+        slots->hint = w;
+    }
+}
+
+// Tira uma posição do conjunto
+void freeSlotsRemove(FreeSlots *slots, uint32_t slot) {
+    slots->bits[slot / 64] &= ~(1ull << (slot % 64));
+    slots->count--;
+}
+
+// Retorna a menor posição livre, ou uma nova se não houver
+// A busca continua de onde a anterior parou, então o custo total é amortizado
+uint32_t freeSlotsTake(FreeSlots *slots) {
+    if (slots->count == 0) {
+        return slots->used++;
+    }
+    while (slots->bits[slots->hint] == 0) {
+        slots->hint++;
+    }
+    uint32_t slot = (uint32_t)(slots->hint * 64) + (uint32_t)__builtin_ctzll(slots->bits[slots->hint]);
+    freeSlotsRemove(slots, slot);
+    return slot;
+}
+
+// Devolve uma posição; as livres no topo não entram no conjunto, fazem 'used' recuar
+void freeSlotsRelease(FreeSlots *slots, uint32_t slot) {
+    if (slot + 1 < slots->used) {
+        freeSlotsAdd(slots, slot);
+        return;
+    }
+    slots->used--;
+    while (slots->used > 0 && freeSlotsContains(slots, slots->used - 1)) {
+        freeSlotsRemove(slots, slots->used - 1);
+        slots->used--;
+    }
+}
+
+// Libera a memória do conjunto
+void destroyFreeSlots(FreeSlots *slots) {
+    free(slots->bits);
+    initFreeSlots(slots);
+}
+
+// --- Funções de Prazo e do Heap de Prioridades ---
+
+// Número de dias de 1970-01-01 até a data (calendário gregoriano proléptico)
+int32_t daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Tamanho do texto de um prazo (AAAA-MM-DD, com folga para datas fora do intervalo usual)
+#define DUE_TEXT_SIZE 32
+
+// Escreve em 'buffer' (DUE_TEXT_SIZE bytes) o prazo como AAAA-MM-DD, ou "-" sem prazo
+void formatDueDate(int32_t due, char *buffer) {
+    if (due == 0) {
+        strcpy(buffer, "-");
+        return;
+    }
+    int z = due + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int day = doy - (153 * mp + 2) / 5 + 1;
+    int month = mp < 10 ? mp + 3 : mp - 9;
+    int year = yoe + era * 400 + (month <= 2);
+    snprintf(buffer, DUE_TEXT_SIZE, "%04d-%02d-%02d", year, month, day);
+}
+
+
+// Inicializa o heap vazio
+void initTaskHeap(TaskHeap *heap) {
+    heap->items = NULL;
+    heap->count = 0;
+    heap->capacity = 0;
+}
+
+// Indica se 'a' vem antes de 'b': maior prioridade, depois o prazo mais
+// próximo (sem prazo por último) e, no empate, o menor ID
+bool taskBefore(const Task *a, const Task *b) {
+    if (a->priority != b->priority) {
+        return a->priority > b->priority;
+    }
+    if (a->due != b->due) {
+        if (a->due == 0 || b->due == 0) {
+            return b->due == 0;
+        }
+        return a->due < b->due;
+    }
+    return a->id < b->id;
+}
+
+// Coloca 'task' na posição 'pos' do heap
+void heapPlace(TaskHeap *heap, size_t pos, Task *task) {
+    heap->items[pos] = task;
+    task->heap_pos = (uint32_t)pos;
+}
+
+// Sobe a tarefa da posição 'pos' até o lugar dela
+void heapSiftUp(TaskHeap *heap, size_t pos) {
+    Task *task = heap->items[pos];
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (!taskBefore(task, heap->items[parent])) {
+            break;
+        }
+        heapPlace(heap, pos, heap->items[parent]);
+        pos = parent;
+    }
+    heapPlace(heap, pos, task);
+}
+
+// Desce a tarefa da posição 'pos' até o lugar dela
+void heapSiftDown(TaskHeap *heap, size_t pos) {
+    Task *task = heap->items[pos];
+    for (;;) {
+        size_t child = 2 * pos + 1;
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count && taskBefore(heap->items[child + 1], heap->items[child])) {
+            child++;
+        }
+        if (!taskBefore(heap->items[child], task)) {
+            break;
+        }
+        heapPlace(heap, pos, heap->items[child]);
+        pos = child;
+    }
+    heapPlace(heap, pos, task);
+}
+
+// Insere uma tarefa pendente no heap
+void heapInsert(TaskHeap *heap, Task *task) {
+    if (heap->count == heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 64;
+        Task **items = (Task **)realloc(heap->items, capacity * sizeof(Task *));
+        if (!items) {
+            perror("Erro ao alocar memória para o heap de prioridades");
+            exit(EXIT_FAILURE);
+        }
+        heap->items = items;
+        heap->capacity = capacity;
+    }
+    heap->items[heap->count] = task;
+    heapSiftUp(heap, heap->count++);
+}
+
+// Retira uma tarefa qualquer do heap, pondo a última no lugar dela
+void heapRemove(TaskHeap *heap, Task *task) {
+    size_t pos = task->heap_pos;
+    task->heap_pos = NOT_IN_HEAP;
+    Task *last = heap->items[--heap->count];
+    if (pos < heap->count) {
+        heapPlace(heap, pos, last);
+        heapSiftUp(heap, pos);
+        heapSiftDown(heap, last->heap_pos);
+    }
+}
+
+// Reposiciona uma tarefa do heap depois de sua prioridade ou prazo mudar
+void heapUpdate(TaskHeap *heap, Task *task) {
+    heapSiftUp(heap, task->heap_pos);
+    heapSiftDown(heap, task->heap_pos);
+}
+
+// Libera a memória do heap
+void destroyTaskHeap(TaskHeap *heap) {
+    free(heap->items);
+    initTaskHeap(heap);
+}
+
+// --- Funções da Lista de Tarefas ---
+
+// Inicializa a lista de tarefas
+void initTaskList(TaskList *list) {
+    list->head = NULL;
+    list->tail = NULL;
+    for (int state = 0; state < 2; state++) {
+        list->state_head[state] = NULL;
+        list->state_tail[state] = NULL;
+        list->state_count[state] = 0;
+    }
+    list->next_id = 1; // Começa os IDs das tarefas a partir de 1
+    initTaskIndex(&list->index);
+    initOrderedIndex(&list->order);
+    initSearchIndex(&list->search);
+    initDescriptionPack(&list->pack);
+    list->layout = LAYOUT_LINKED;
+    initTaskColumns(&list->columns);
+    initCompletionMap(&list->completion);
+    initFreeSlots(&list->free_slots);
+    initTaskHeap(&list->agenda);
+    initNodePool(&list->task_pool, sizeof(Task));
+    initTextArena(&list->text);
+    initStringTable(&list->strings);
+    list->mapped = NULL;
+    list->mapped_size = 0;
+}
+
+// Escolhe a organização da memória de uma lista ainda vazia
+void setTaskListLayout(TaskList *list, TaskLayout layout) {
+    list->layout = layout;
+}
+
+// Busca uma tarefa pelo ID em tempo constante (NULL se não encontrada)
+Task *findTask(const TaskList *list, int id) {
+    COUNT(COUNTER_LOOKUPS, 1);
+    return taskIndexFind(&list->index, id);
+}
+
+// Obtém um nó do pool com todos os campos iniciados, exceto a descrição
+Task *allocTask(TaskList *list, int id) {
+    Task *newTask = (Task *)poolAlloc(&list->task_pool);
+    newTask->id = id;
+    newTask->completed = false; // Tarefa inicialmente não concluída
+    newTask->priority = 0;
+    newTask->due = 0;
+    newTask->heap_pos = NOT_IN_HEAP;
+    newTask->description = NULL;
+    newTask->next = NULL;
+    newTask->prev = NULL;
+    newTask->state_next = NULL;
+    newTask->state_prev = NULL;
+    return newTask;
+}
+
+// Aloca e cria uma nova tarefa a partir de uma descrição com tamanho conhecido
+// (não precisa ter terminador)
+// O nó vem do pool; descrições curtas ficam no próprio nó e as longas são
+// internadas, de modo que textos repetidos são guardados uma única vez
+Task *createTaskWithLength(TaskList *list, int id, const char *description, size_t length) {
+    Task *newTask = allocTask(list, id);
+    if (length < INLINE_TEXT_SIZE) {
+        memcpy(newTask->inline_desc, description, length);
+        newTask->inline_desc[length] = '\0';
+        newTask->description = newTask->inline_desc;
+    } else {
+        newTask->description = internText(&list->strings, &list->text, description, length);
+    }
+    return newTask;
+}
+
+// Aloca e cria uma nova tarefa
+Task *createTask(TaskList *list, int id, const char *description) {
+    return createTaskWithLength(list, id, description, strlen(description));
+}
+
+// Indica se uma descrição aponta para o snapshot mapeado (não pertence a nenhum alocador)
+bool isMappedText(const TaskList *list, const char *text) {
+    return list->mapped != NULL && text >= list->mapped && text < list->mapped + list->mapped_size;
+}
+
+// Dá à tarefa que entra na lista sua posição no mapa de conclusão (--dense-ids)
+// Com LAYOUT_COLUMNS, a posição nas colunas, já reaproveitada, serve também
+void acquireTaskSlot(TaskList *list, Task *task) {
+    if (list->completion.by_slot && list->layout != LAYOUT_COLUMNS) {
+        task->slot = freeSlotsTake(&list->free_slots);
+    }
+}
+
+// Devolve a posição de uma tarefa que saiu da lista
+// Se ela voltar (desfazer, refazer), ganha uma posição nova; o ID não muda
+void releaseTaskSlot(TaskList *list, const Task *task) {
+    if (list->completion.by_slot && list->layout != LAYOUT_COLUMNS) {
+        freeSlotsRelease(&list->free_slots, task->slot);
+    }
+}
+
+// Liga o modo de IDs densos: os IDs continuam só crescendo, mas o mapa de
+// conclusão passa a ser indexado pela posição de cada tarefa na lista, que é
+// reaproveitada quando ela sai, e fica do tamanho da lista
+// Refaz o mapa a partir das tarefas atuais (chamada logo após a carga)
+void enableDenseIds(TaskList *list) {
+    CompletionMap *map = &list->completion;
+    destroyCompletionMap(map);
+    map->by_slot = true;
+    for (Task *task = list->head; task != NULL; task = task->next) {
+        acquireTaskSlot(list, task);
+        completionSet(map, task, true);
+    }
+}
+
+// Devolve uma tarefa e sua descrição aos alocadores da lista
+void destroyTask(TaskList *list, Task *task) {
+    if (task->description != task->inline_desc && !isMappedText(list, task->description)) {
+        releaseInterned(&list->strings, &list->text, task->description);
+    }
+    poolFree(&list->task_pool, task);
+}
+
+// Encadeia uma tarefa no final da lista do seu estado atual
+void linkTaskState(TaskList *list, Task *task) {
+    int state = task->completed;
+    task->state_next = NULL;
+    task->state_prev = list->state_tail[state];
+    if (list->state_tail[state] == NULL) {
+        list->state_head[state] = task;
+    } else {
+        list->state_tail[state]->state_next = task;
+    }
+    list->state_tail[state] = task;
+    list->state_count[state]++;
+}
+
+// Desencadeia uma tarefa da lista do seu estado atual em O(1)
+void unlinkTaskState(TaskList *list, Task *task) {
+    int state = task->completed;
+    if (task->state_prev == NULL) {
+        list->state_head[state] = task->state_next;
+    } else {
+        task->state_prev->state_next = task->state_next;
+    }
+    if (task->state_next == NULL) {
+        list->state_tail[state] = task->state_prev;
+    } else {
+        task->state_next->state_prev = task->state_prev;
+    }
+    task->state_next = NULL;
+    task->state_prev = NULL;
+    list->state_count[state]--;
+}
+
+// Muda o estado de uma tarefa que está na lista, movendo-a para o final da
+// lista do novo estado
+void setTaskCompleted(TaskList *list, Task *task, bool completed) {
+    if (task->completed == completed) {
+        return;
+    }
+    unlinkTaskState(list, task);
+    task->completed = completed;
+    linkTaskState(list, task);
+    if (completed) {
+        heapRemove(&list->agenda, task);
+    } else {
+        heapInsert(&list->agenda, task);
+    }
+    if (list->layout == LAYOUT_COLUMNS) {
+        columnsSetCompleted(&list->columns, task);
+    }
+    completionSet(&list->completion, task, true);
+}
+
+// Muda a prioridade e o prazo de uma tarefa que está na lista
+void setTaskSchedule(TaskList *list, Task *task, int priority, int32_t due) {
+    task->priority = (int8_t)priority;
+    task->due = due;
+    if (task->heap_pos != NOT_IN_HEAP) {
+        heapUpdate(&list->agenda, task);
+    }
+}
+
+// Encadeia uma tarefa no final da lista (e da lista do seu estado) e a registra no índice
+void attachTask(TaskList *list, Task *task) {
+    task->next = NULL;
+    task->prev = list->tail;
+    if (list->tail == NULL) {
+        list->head = task;
+    } else {
+        list->tail->next = task;
+    }
+    list->tail = task;
+    linkTaskState(list, task);
+    if (!task->completed) {
+        heapInsert(&list->agenda, task);
+    }
+    taskIndexInsert(&list->index, task->id, task);
+    orderInsert(&list->order, task->id, task);
+    searchIndexTask(&list->search, &list->text, task, true);
+    if (list->pack.valid) {
+        packAppend(&list->pack, task);
+    }
+    if (list->layout == LAYOUT_COLUMNS) {
+        columnsAdd(&list->columns, task);
+    }
+    acquireTaskSlot(list, task);
+    completionSet(&list->completion, task, true);
+}
+
+// Desencadeia uma tarefa da lista em O(1) e a retira do índice
+// O nó continua alocado; quem chama decide se o libera ou o guarda
+void detachTask(TaskList *list, Task *task) {
+    if (task->prev == NULL) { // Se for o primeiro nó
+        list->head = task->next;
+    } else {
+        task->prev->next = task->next;
+    }
+    if (task->next == NULL) { // Se for o último nó
+        list->tail = task->prev;
+    } else {
+        task->next->prev = task->prev;
+    }
+    task->next = NULL;
+    task->prev = NULL;
+    unlinkTaskState(list, task);
+    if (task->heap_pos != NOT_IN_HEAP) {
+        heapRemove(&list->agenda, task);
+    }
+    taskIndexRemove(&list->index, task->id);
+    orderRemove(&list->order, task->id);
+    searchIndexTask(&list->search, &list->text, task, false);
+    list->pack.valid = false;
+    if (list->layout == LAYOUT_COLUMNS) {
+        columnsRemove(&list->columns, task);
+    }
+    completionSet(&list->completion, task, false);
+    releaseTaskSlot(list, task);
+}
+
+// Adiciona uma tarefa ao final da lista e retorna o ID dela
+int addTask(TaskList *list, const char *description) {
+    Task *newTask = createTask(list, list->next_id++, description);
+    attachTask(list, newTask);
+    notify("Tarefa '%s' (ID: %d) adicionada com sucesso.\n", description, newTask->id);
+    return newTask->id;
+}
+
+// Adiciona de uma vez uma tarefa por linha de 'buffer' (linhas vazias são ignoradas)
+// Conta as linhas antes para dimensionar o pool e o índice, cria todos os nós
+// numa passada e encadeia o lote inteiro no final da lista de uma só vez
+// Retorna o número de tarefas criadas; '*first_id' recebe o ID da primeira
+size_t addTasksFromBuffer(TaskList *list, const char *buffer, size_t length, int *first_id) {
+    const char *end = buffer + length;
+    size_t lines = 0;
+    for (const char *p = buffer; p < end; ) {
+        const char *newline = (const char *)memchr(p, '\n', (size_t)(end - p));
+        const char *line_end = newline ? newline : end;
+        if (line_end > p && !(line_end - p == 1 && *p == '\r')) {
+            lines++;
+        }
+        p = line_end + 1;
+    }
+    *first_id = list->next_id;
+    if (lines == 0) {
+        return 0;
+    }
+    poolReserve(&list->task_pool, lines);
+    taskIndexReserve(&list->index, list->index.count + lines);
+
+    Task *first = NULL;
+    Task *last = NULL;
+    for (const char *p = buffer; p < end; ) {
+        const char *newline = (const char *)memchr(p, '\n', (size_t)(end - p));
+        const char *line_end = newline ? newline : end;
+        size_t len = (size_t)(line_end - p);
+        if (len > 0 && p[len - 1] == '\r') {
+            len--;
+        }
+        if (len > 0) {
+            Task *task = createTaskWithLength(list, list->next_id++, p, len);
+            task->prev = last;
+            if (last == NULL) {
+                first = task;
+            } else {
+                last->next = task;
+            }
+            last = task;
+            linkTaskState(list, task);
+            heapInsert(&list->agenda, task);
+            taskIndexInsert(&list->index, task->id, task);
+            orderInsert(&list->order, task->id, task);
+            searchIndexTask(&list->search, &list->text, task, true);
+            if (list->pack.valid) {
+                packAppend(&list->pack, task);
+            }
+            if (list->layout == LAYOUT_COLUMNS) {
+                columnsAdd(&list->columns, task);
+            }
+            acquireTaskSlot(list, task);
+            completionSet(&list->completion, task, true);
+        }
+        p = line_end + 1;
+    }
+
+    // Encadeia o lote inteiro no final da lista
+    first->prev = list->tail;
+    if (list->tail == NULL) {
+        list->head = first;
+    } else {
+        list->tail->next = first;
+    }
+    list->tail = last;
+    notify("%zu tarefa(s) importada(s) (IDs %d a %d).\n", lines, *first_id, list->next_id - 1);
+    return lines;
+}
+
+// Filtro que aceita todas as tarefas
+void initTaskFilter(TaskFilter *filter) {
+    filter->state = FILTER_ALL;
+    filter->min_id = INT_MIN;
+    filter->max_id = INT_MAX;
+    filter->offset = 0;
+    filter->limit = 0;
+    filter->sorted = false;
+}
+
+// Listagem em andamento: aplica a paginação e emite o cabeçalho na primeira linha
+typedef struct {
+    OutputBuffer *out;
+    size_t skip;      // Tarefas ainda a pular
+    size_t remaining; // Tarefas ainda a listar (SIZE_MAX = sem limite)
+    size_t listed;    // Tarefas já listadas
+    uint64_t started; // Início da listagem (counterTicks)
+} Listing;
+
+// Buffer das listagens (um por thread, já que clientes do servidor listam em paralelo)
+static __thread OutputBuffer listing_output;
+
+// Começa uma listagem paginada na saída de quem emitiu o comando
+void startListing(Listing *listing, size_t offset, size_t limit) {
+    FILE *stream = messageStream();
+    if (thread_capture == NULL) {
+        fflush(stream); // Mantém a ordem em relação ao que já foi impresso via stdio
+    }
+    initOutputBuffer(&listing_output, fileno(stream));
+    listing_output.capture = thread_capture;
+    listing->out = &listing_output;
+    listing->skip = offset;
+    listing->remaining = limit != 0 ? limit : SIZE_MAX;
+    listing->listed = 0;
+#ifndef TAREFA_NO_COUNTERS
+    listing->started = counterTicks();
+#endif
+}
+
+// Conclui a listagem, emitindo-a (ou 'empty_message' se nada foi listado)
+// Retorna o número de tarefas listadas
+size_t finishListing(Listing *listing, const char *empty_message) {
+    COUNT(COUNTER_LISTINGS, 1);
+    COUNT(COUNTER_LISTED, listing->listed);
+    if (listing->listed == 0) {
+        report("%s\n", empty_message);
+        return 0;
+    }
+    outputLiteral(listing->out, "------------------------\n");
+    flushOutput(listing->out);
+#ifndef TAREFA_NO_COUNTERS
+    COUNT(COUNTER_LISTING_TICKS, counterTicks() - listing->started);
+#endif
+    return listing->listed;
+}
+
+// Acrescenta uma linha à listagem a partir dos campos da tarefa
+// Retorna false quando a página está cheia
+bool listingAddFields(Listing *listing, int id, bool completed, const char *description) {
+    if (listing->skip > 0) {
+        listing->skip--;
+        return true;
+    }
+    if (listing->remaining == 0) {
+        return false;
+    }
+    OutputBuffer *out = listing->out;
+    if (listing->listed == 0) {
+        outputLiteral(out, "\n--- Lista de Tarefas ---\n");
+    }
+    outputLiteral(out, "ID: ");
+    outputInt(out, id);
+    // 'X' para concluída, ' ' para pendente
+    if (completed) {
+        outputLiteral(out, " | Estado: [X] | Descrição: ");
+    } else {
+        outputLiteral(out, " | Estado: [ ] | Descrição: ");
+    }
+    outputBytes(out, description, strlen(description));
+    outputLiteral(out, "\n");
+    listing->listed++;
+    listing->remaining--;
+    return listing->remaining > 0;
+}
+
+// Acrescenta uma tarefa à listagem; retorna false quando a página está cheia
+bool listingAdd(Listing *listing, const Task *task) {
+    return listingAddFields(listing, task->id, task->completed, task->description);
+}
+
+// Lista as tarefas que passam no filtro, com paginação
+// Em ordem de ID (ou com intervalo de IDs) e sem --dense-ids, o mapa de
+// conclusão dá, palavra a palavra, os IDs do intervalo no estado pedido: o
+// deslocamento é pulado com popcount, 64 IDs por vez, e as tarefas da página
+// saem do índice ordenado (sem filtro de estado) ou do índice de IDs. Caso
+// contrário, percorre apenas a lista do estado pedido (ou a lista completa),
+// na ordem em que as tarefas entraram nela; com LAYOUT_COLUMNS, percorre os
+// bitsets das colunas, na ordem das posições, pulando o deslocamento com
+// popcount. A varredura para assim que a página enche
+// Nas listas encadeadas (e em ordem de ID com --dense-ids), o deslocamento é
+// andado tarefa por tarefa, e a listagem custa O(deslocamento + página): essa
+// ordem não é a dos IDs, então o mapa de conclusão não diz onde ela cai
+// A listagem inteira é formatada num buffer e emitida com poucas chamadas a
+// writev; descrições longas saem direto da memória onde estão guardadas
+// Retorna o número de tarefas listadas
+size_t listTasksFiltered(const TaskList *list, const TaskFilter *filter) {
+    Listing listing;
+    startListing(&listing, filter->offset, filter->limit);
+
+    if (filter->sorted || filter->min_id != INT_MIN || filter->max_id != INT_MAX) {
+        OrderCursor cursor = orderSeek(&list->order, filter->min_id);
+        const Task *task = orderNext(&cursor);
+        if (!list->completion.by_slot && task != NULL && task->id >= 0 && task->id <= filter->max_id) {
+            const CompletionMap *map = &list->completion;
+            size_t first = (size_t)task->id;
+            size_t last = (size_t)filter->max_id < map->words * 64 ? (size_t)filter->max_id : map->words * 64 - 1;
+            size_t w = first / 64;
+            uint64_t bits = completionStateWord(map, w, filter->state) & completionRangeMask(w, first, last);
+            while (w < last / 64 && listing.skip >= (size_t)__builtin_popcountll(bits)) {
+                listing.skip -= (size_t)__builtin_popcountll(bits);
+                w++;
+                bits = completionStateWord(map, w, filter->state) & completionRangeMask(w, first, last);
+            }
+            if (filter->state == FILTER_ALL) {
+                // O resto do deslocamento cai dentro desta palavra
+                cursor = orderSeek(&list->order, (int)(w * 64 > first ? w * 64 : first));
+                while ((task = orderNext(&cursor)) != NULL && task->id <= filter->max_id) {
+                    if (!listingAdd(&listing, task)) {
+                        break;
+                    }
+                }
+            } else {
+                bool more = true;
+                while (more) {
+                    while (more && bits != 0) {
+                        int id = (int)(w * 64 + (size_t)__builtin_ctzll(bits));
+                        bits &= bits - 1;
+                        more = listingAdd(&listing, taskIndexFind(&list->index, id));
+                    }
+                    if (w == last / 64) {
+                        break;
+                    }
+                    w++;
+                    bits = completionStateWord(map, w, filter->state) & completionRangeMask(w, first, last);
+                }
+            }
+        } else {
+            // IDs negativos não estão no mapa de conclusão; com --dense-ids,
+            // o mapa não segue a ordem dos IDs
+            for (; task != NULL && task->id <= filter->max_id; task = orderNext(&cursor)) {
+                if ((filter->state == FILTER_PENDING && task->completed) ||
+                    (filter->state == FILTER_COMPLETED && !task->completed)) {
+                    continue;
+                }
+                if (!listingAdd(&listing, task)) {
+                    break;
+                }
+            }
+        }
+    } else if (list->layout == LAYOUT_COLUMNS) {
+        const TaskColumns *columns = &list->columns;
+        bool more = true;
+        for (size_t w = 0; more && w * 64 < columns->count; w++) {
+            uint64_t bits = columnsStateWord(columns, w, filter->state);
+            if (listing.skip >= (size_t)__builtin_popcountll(bits)) {
+                listing.skip -= (size_t)__builtin_popcountll(bits);
+                continue;
+            }
+            while (more && bits != 0) {
+                size_t slot = w * 64 + (size_t)__builtin_ctzll(bits);
+                bits &= bits - 1;
+                more = listingAddFields(&listing, columns->ids[slot],
+                                        (columns->completed[w] >> (slot % 64)) & 1,
+                                        columns->descriptions[slot]);
+            }
+        }
+    } else if (filter->state == FILTER_ALL) {
+        // Ordem de entrada na lista: cada tarefa pulada é visitada
+        for (const Task *task = list->head; task != NULL; task = task->next) {
+            if (!listingAdd(&listing, task)) {
+                break;
+            }
+        }
+    } else {
+        const Task *task = list->state_head[filter->state == FILTER_COMPLETED];
+        for (; task != NULL; task = task->state_next) {
+            if (!listingAdd(&listing, task)) {
+                break;
+            }
+        }
+    }
+
+    return finishListing(&listing, "Nenhuma tarefa encontrada com esse filtro.");
+}
+
+// Lista todas as tarefas na lista
+void listTasks(const TaskList *list) {
+    if (list->head == NULL) {
+        report("Nenhuma tarefa na lista.\n");
+        return;
+    }
+    TaskFilter filter;
+    initTaskFilter(&filter);
+    listTasksFiltered(list, &filter);
+}
+
+// Número máximo de termos numa busca
+#define SEARCH_QUERY_MAX 16
+
+// Lista, em ordem de ID, as tarefas cujas descrições contêm todas as palavras
+// de 'query' (sem diferenciar maiúsculas de minúsculas nas letras ASCII; só
+// as primeiras SEARCH_QUERY_MAX palavras contam)
+// Os postings do termo mais raro são percorridos e cada ID é procurado nos
+// demais por busca binária, então o custo acompanha o número de postings
+// envolvidos e não o tamanho da lista
+// Na primeira busca, o índice é construído a partir da lista inteira
+// Retorna o número de tarefas listadas
+size_t searchTasks(TaskList *list, const char *query) {
+    if (!list->search.built) {
+        list->search.built = true;
+        for (const Task *task = list->head; task != NULL; task = task->next) {
+            searchIndexTask(&list->search, &list->text, task, true);
+        }
+    }
+
+    const SearchTerm *terms[SEARCH_QUERY_MAX];
+    size_t term_count = 0;
+    char term[SEARCH_TERM_MAX];
+    size_t length;
+    bool missing = false;
+    while ((length = nextSearchTerm(&query, term)) > 0 && term_count < SEARCH_QUERY_MAX) {
+        const SearchTerm *entry = searchFindTerm(&list->search, term, length, hashText(term, length), NULL);
+        if (entry == NULL) {
+            missing = true; // Uma palavra que não aparece em nenhuma descrição
+            break;
+        }
+        terms[term_count++] = entry;
+    }
+
+    Listing listing;
+    startListing(&listing, 0, 0);
+    if (!missing && term_count > 0) {
+        // O termo mais raro guia a interseção
+        for (size_t i = 1; i < term_count; i++) {
+            if (terms[i]->count < terms[0]->count) {
+                const SearchTerm *rarest = terms[i];
+                terms[i] = terms[0];
+                terms[0] = rarest;
+            }
+        }
+        for (size_t i = 0; i < terms[0]->count; i++) {
+            int id = terms[0]->ids[i];
+            bool all = true;
+            for (size_t t = 1; t < term_count && all; t++) {
+                size_t pos = postingsLowerBound(terms[t]->ids, terms[t]->count, id);
+                all = pos < terms[t]->count && terms[t]->ids[pos] == id;
+            }
+            if (all) {
+                listingAdd(&listing, findTask(list, id));
+            }
+        }
+    }
+    return finishListing(&listing, "Nenhuma tarefa encontrada para a busca.");
+}
+
+// Varredura do pacote escolhida para a CPU
+static PackScanFn pack_scan = NULL;
+static pthread_once_t pack_scan_once = PTHREAD_ONCE_INIT;
+
+// Escolhe a varredura do pacote uma única vez, mesmo com várias threads buscando
+void choosePackScan(void) {
+    pack_scan = selectPackScan();
+}
+
+// Lista as tarefas cujas descrições contêm o trecho 'needle' (diferencia
+// maiúsculas de minúsculas e aceita qualquer caractere, inclusive pontuação)
+// Percorre o pacote contíguo de descrições com a varredura vetorial; o
+// pacote é remontado antes se alguma tarefa saiu da lista desde a última busca
+// Retorna o número de tarefas listadas
+size_t findTasks(TaskList *list, const char *needle) {
+    pthread_once(&pack_scan_once, choosePackScan);
+    PackScanFn scan = pack_scan;
+    DescriptionPack *pack = &list->pack;
+    if (!pack->valid) {
+        pack->used = 0;
+        pack->count = 0;
+        pack->valid = true;
+        for (const Task *task = list->head; task != NULL; task = task->next) {
+            packAppend(pack, task);
+        }
+    }
+
+    Listing listing;
+    startListing(&listing, 0, 0);
+    size_t length = strlen(needle);
+    size_t entry = 0;
+    size_t at = 0;
+    while (length > 0 && at < pack->used) {
+        // Um único byte já é buscado com memchr (vetorizado pela libc)
+        size_t match = (length == 1 ? packScanScalar : scan)(pack->text, pack->used, needle, length, at);
+        if (match == SIZE_MAX) {
+            break;
+        }
+        // Avança até a descrição que contém a ocorrência (as ocorrências vêm em ordem)
+        while (entry + 1 < pack->count && pack->entries[entry + 1].offset <= match) {
+            entry++;
+        }
+        listingAdd(&listing, findTask(list, pack->entries[entry].id));
+        // Uma tarefa aparece uma única vez: continua na descrição seguinte
+        at = entry + 1 < pack->count ? pack->entries[entry + 1].offset : pack->used;
+        entry++;
+    }
+    return finishListing(&listing, "Nenhuma tarefa encontrada para o trecho.");
+}
+
+// Marca uma tarefa como concluída
+bool completeTask(TaskList *list, int id) {
+    Task *current = findTask(list, id);
+    if (current == NULL) {
+        report("Tarefa com ID %d não encontrada.\n", id);
+        return false;
+    }
+    if (current->completed) {
+        report("Tarefa %d já está concluída.\n", id);
+        return false;
+    }
+    setTaskCompleted(list, current, true);
+    notify("Tarefa %d marcada como concluída.\n", id);
+    return true;
+}
+
+// Restringe 'set' às tarefas que estão na lista (e, com only_pending, às
+// ainda pendentes), palavra a palavra sobre o mapa de conclusão
+// Com --dense-ids, o mapa não segue os IDs, e cada ID é procurado no índice
+// Retorna quantos IDs restaram
+size_t filterIdSet(const TaskList *list, IdSet *set, bool only_pending) {
+    if (set->bits == NULL) {
+        return 0; // Conjunto vazio
+    }
+    const CompletionMap *map = &list->completion;
+    if (map->by_slot) {
+        size_t count = 0;
+        size_t base = (size_t)set->first / 64;
+        IdSetCursor cursor;
+        initIdSetCursor(&cursor, set->first, set->last, set->bits);
+        int id;
+        while (idSetNext(&cursor, &id)) {
+            const Task *task = findTask(list, id);
+            if (task == NULL || (only_pending && task->completed)) {
+                set->bits[(size_t)id / 64 - base] &= ~(1ull << (id % 64));
+            } else {
+                count++;
+            }
+        }
+        return count;
+    }
+    size_t base = (size_t)set->first / 64;
+    size_t words = idSetWords(set->first, set->last);
+    size_t count = 0;
+    for (size_t k = 0; k < words; k++) {
+        size_t w = base + k;
+        uint64_t allowed = w < map->words ? map->present[w] : 0;
+        if (only_pending && w < map->words) {
+            allowed &= ~map->completed[w];
+        }
+        set->bits[k] &= allowed;
+        count += (size_t)__builtin_popcountll(set->bits[k]);
+    }
+    return count;
+}
+
+// Conclui as tarefas pendentes de um conjunto de IDs numa única passada
+// As tarefas afetadas saem de operações palavra a palavra sobre o mapa de
+// conclusão (presente e não concluída); só os nós delas são visitados
+// 'set' fica reduzido aos IDs efetivamente concluídos
+// Retorna quantas tarefas foram concluídas
+size_t completeTaskSet(TaskList *list, IdSet *set) {
+    size_t done = filterIdSet(list, set, true);
+    if (done == 0) {
+        report("Nenhuma tarefa pendente entre os IDs informados.\n");
+        return 0;
+    }
+    IdSetCursor cursor;
+    initIdSetCursor(&cursor, set->first, set->last, set->bits);
+    int id;
+    while (idSetNext(&cursor, &id)) {
+        setTaskCompleted(list, findTask(list, id), true);
+    }
+    notify("%zu tarefa(s) marcada(s) como concluída(s).\n", done);
+    return done;
+}
+
+// Remove da lista as tarefas de um conjunto de IDs numa única passada
+// '*removed' recebe os nós retirados, encadeados por 'next' em ordem crescente
+// de ID; a posse deles passa para quem chama
+// 'set' fica reduzido aos IDs efetivamente removidos
+// Retorna quantas tarefas foram removidas
+size_t removeTaskSet(TaskList *list, IdSet *set, Task **removed) {
+    *removed = NULL;
+    size_t count = filterIdSet(list, set, false);
+    if (count == 0) {
+        report("Nenhuma tarefa encontrada entre os IDs informados.\n");
+        return 0;
+    }
+    Task *last = NULL;
+    IdSetCursor cursor;
+    initIdSetCursor(&cursor, set->first, set->last, set->bits);
+    int id;
+    while (idSetNext(&cursor, &id)) {
+        Task *task = findTask(list, id);
+        detachTask(list, task);
+        if (last == NULL) {
+            *removed = task;
+        } else {
+            last->next = task;
+        }
+        last = task;
+    }
+    notify("%zu tarefa(s) removida(s) com sucesso.\n", count);
+    return count;
+}
+
+// Lista as 'count' tarefas pendentes mais urgentes, em ordem de prioridade e prazo
+// Percorre o heap como uma árvore a partir da raiz, mantendo numa fila de
+// prioridade auxiliar só a fronteira já alcançada (no máximo count + 1
+// posições), então o custo é O(count log count), sem alterar o heap
+size_t nextTasks(const TaskList *list, size_t count) {
+    const TaskHeap *heap = &list->agenda;
+    Listing listing;
+    startListing(&listing, 0, count);
+    size_t limit = count < heap->count ? count : heap->count;
+    size_t *frontier = (size_t *)malloc((limit + 1) * sizeof(size_t));
+    if (!frontier) {
+        perror("Erro ao alocar memória para as próximas tarefas");
+        exit(EXIT_FAILURE);
+    }
+    size_t size = 0;
+    if (limit > 0) {
+        frontier[size++] = 0;
+    }
+    while (size > 0 && listing.remaining > 0) {
+        // Retira a posição mais urgente da fronteira
+        const Task *task = heap->items[frontier[0]];
+        size_t pos = frontier[0];
+        size_t moved = frontier[--size];
+        size_t hole = 0;
+        for (;;) {
+            size_t child = 2 * hole + 1;
+            if (child >= size) {
+                break;
+            }
+            if (child + 1 < size && taskBefore(heap->items[frontier[child + 1]], heap->items[frontier[child]])) {
+                child++;
+            }
+            if (!taskBefore(heap->items[frontier[child]], heap->items[moved])) {
+                break;
+            }
+            frontier[hole] = frontier[child];
+            hole = child;
+        }
+        if (size > 0) {
+            frontier[hole] = moved;
+        }
+
+        OutputBuffer *out = listing.out;
+        if (listing.listed == 0) {
+            outputLiteral(out, "\n--- Próximas Tarefas ---\n");
+        }
+        char due[DUE_TEXT_SIZE];
+        formatDueDate(task->due, due);
+        outputLiteral(out, "ID: ");
+        outputInt(out, task->id);
+        outputLiteral(out, " | Prioridade: ");
+        outputInt(out, task->priority);
+        outputLiteral(out, " | Prazo: ");
+        outputBytes(out, due, strlen(due));
+        outputLiteral(out, " | Descrição: ");
+        outputBytes(out, task->description, strlen(task->description));
+        outputLiteral(out, "\n");
+        listing.listed++;
+        listing.remaining--;
+
+        // Os filhos da posição retirada entram na fronteira
+        for (size_t child = 2 * pos + 1; child <= 2 * pos + 2 && child < heap->count && size <= limit; child++) {
+            size_t at = size++;
+            while (at > 0 && taskBefore(heap->items[child], heap->items[frontier[(at - 1) / 2]])) {
+                frontier[at] = frontier[(at - 1) / 2];
+                at = (at - 1) / 2;
+            }
+            frontier[at] = child;
+        }
+    }
+    free(frontier);
+    return finishListing(&listing, "Nenhuma tarefa pendente.");
+}
+
+// Mostra quantas tarefas existem, quantas estão concluídas e a porcentagem,
+// contando com popcount os bits do mapa de conclusão em [first, last]
+// Com --dense-ids, o mapa inteiro é contado assim quando o intervalo cobre
+// todas as tarefas; senão, o intervalo é percorrido no índice ordenado
+void printStats(const TaskList *list, int first, int last) {
+    size_t present = 0, completed = 0;
+    if (!list->completion.by_slot) {
+        completionCount(&list->completion, first, last, &present, &completed);
+    } else {
+        int low = first > 0 ? first : 0; // Como no mapa por ID, IDs negativos não contam
+        OrderCursor cursor = orderSeek(&list->order, INT_MIN);
+        const Task *task = orderNext(&cursor);
+        if ((task == NULL || task->id >= low) && last >= list->next_id - 1) {
+            completionCount(&list->completion, 0, INT_MAX, &present, &completed);
+        } else {
+            cursor = orderSeek(&list->order, low);
+            while ((task = orderNext(&cursor)) != NULL && task->id <= last) {
+                present++;
+                completed += task->completed;
+            }
+        }
+    }
+    report("\n--- Estatísticas ---\n");
+    if (first > 0 || last < INT_MAX) {
+        report("IDs de %d a %d\n", first, last < list->next_id ? last : list->next_id - 1);
+    }
+    report("Tarefas: %zu\n", present);
+    report("Concluídas: %zu\n", completed);
+    report("Pendentes: %zu\n", present - completed);
+    report("Progresso: %.1f%%\n", present ? 100.0 * (double)completed / (double)present : 0.0);
+    report("--------------------\n");
+}
+
+// Remove uma tarefa da lista
+// Retorna a tarefa removida (para fins de "desfazer") ou NULL se não encontrada
+// A posse do nó passa para quem chama (ver recordRemove)
+Task *removeTask(TaskList *list, int id) {
+    Task *current = findTask(list, id);
+    if (current == NULL) {
+        report("Tarefa com ID %d não encontrada.\n", id);
+        return NULL; // Tarefa não encontrada
+    }
+
+    detachTask(list, current);
+
+    notify("Tarefa %d ('%s') removida com sucesso.\n", current->id, current->description);
+    return current; // Retorna o nó (ainda com memória alocada para ele e sua descrição)
+}
+
+// Libera toda a memória da lista de tarefas
+// Os nós e descrições são liberados bloco a bloco, sem percorrer a lista
+void destroyTaskList(TaskList *list) {
+    destroySearchIndex(&list->search); // Antes da arena, onde estão os termos
+    destroyDescriptionPack(&list->pack);
+    destroyTaskColumns(&list->columns);
+    destroyCompletionMap(&list->completion);
+    destroyFreeSlots(&list->free_slots);
+    destroyTaskHeap(&list->agenda);
+    destroyNodePool(&list->task_pool);
+    destroyTextArena(&list->text);
+    destroyStringTable(&list->strings);
+    if (list->mapped != NULL) {
+        munmap((void *)list->mapped, list->mapped_size);
+        list->mapped = NULL;
+        list->mapped_size = 0;
+    }
+    list->head = NULL;
+    list->tail = NULL;
+    for (int state = 0; state < 2; state++) {
+        list->state_head[state] = NULL;
+        list->state_tail[state] = NULL;
+        list->state_count[state] = 0;
+    }
+    list->next_id = 1;
+    destroyTaskIndex(&list->index);
+    destroyOrderedIndex(&list->order);
+    notify("Toda a memória da lista de tarefas foi liberada.\n");
+}
+
+// --- Funções de Persistência (Diário e Snapshot) ---
+
+// Identificação do arquivo de snapshot
+#define SNAPSHOT_MAGIC "TARSNAP2"
+// Tamanho do cabeçalho de um registro do diário: tamanho + CRC
+#define JOURNAL_HEADER_SIZE 8
+// Parte fixa da carga de um registro: LSN, tipo, estado, reservado, ID
+#define JOURNAL_FIXED_SIZE 16
+
+// Tabela do CRC-32 (polinômio refletido 0xEDB88320), preenchida na primeira abertura
+uint32_t crc32_table[256];
+
+// Preenche a tabela do CRC-32
+void initCrc32Table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc32_table[i] = c;
+    }
+}
+
+// Calcula o CRC-32 de um bloco de bytes
+uint32_t crc32(const unsigned char *data, size_t size) {
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        c = crc32_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+// Escreve todo o buffer, repetindo em escritas parciais; retorna false em erro
+bool writeAll(int fd, const void *data, size_t size) {
+    const char *p = (const char *)data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// Lê um arquivo inteiro para a memória, com um terminador extra no final
+// Retorna NULL (com errno definido) se o arquivo não puder ser aberto ou lido
+// O chamador libera o buffer com free
+unsigned char *readWholeFile(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    unsigned char *data = (unsigned char *)malloc((size_t)st.st_size + 1);
+    if (!data) {
+        perror("Erro ao alocar memória para leitura do arquivo");
+        exit(EXIT_FAILURE);
+    }
+    size_t done = 0;
+    while (done < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + done, (size_t)st.st_size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            int saved = n < 0 ? errno : EIO;
+            free(data);
+            close(fd);
+            errno = saved;
+            return NULL;
+        }
+        done += (size_t)n;
+    }
+    close(fd);
+    data[done] = '\0';
+    *size = done;
+    return data;
+}
+
+// Monta a concatenação de dois trechos de caminho em memória alocada
+char *concatPath(const char *prefix, const char *suffix) {
+    size_t size = strlen(prefix) + strlen(suffix) + 1;
+    char *path = (char *)malloc(size);
+    if (!path) {
+        perror("Erro ao alocar memória para caminho");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(path, size, "%s%s", prefix, suffix);
+    return path;
+}
+
+// Força para o disco as entradas de um diretório (torna um rename durável)
+void syncDirectory(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+// Garante espaço para mais 'size' bytes no buffer de montagem
+void reserveStoreBuffer(TaskStore *store, size_t size) {
+    size += store->buffer_used;
+    if (size <= store->buffer_capacity) {
+        return;
+    }
+    size_t capacity = store->buffer_capacity ? store->buffer_capacity : 4096;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    store->buffer = (unsigned char *)realloc(store->buffer, capacity);
+    if (!store->buffer) {
+        perror("Erro ao alocar memória para o buffer do diário");
+        exit(EXIT_FAILURE);
+    }
+    store->buffer_capacity = capacity;
+}
+
+// Inicializa o armazenamento desligado (nenhum arquivo é usado)
+void initTaskStore(TaskStore *store, TaskList *list) {
+    store->list = list;
+    store->journal_fd = -1;
+    store->dir_path = NULL;
+    store->journal_path = NULL;
+    store->snapshot_path = NULL;
+    store->next_journal_path = NULL;
+    store->compaction_pid = 0;
+    store->compaction_lsn = 0;
+    store->next_lsn = 1;
+    store->snapshot_lsn = 0;
+    store->journal_records = 0;
+    store->compact_every = 0;
+    store->buffer = NULL;
+    store->buffer_used = 0;
+    store->buffer_capacity = 0;
+    store->batch_depth = 0;
+    store->writer_running = false;
+    store->writer_stop = false;
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_mutex_init(&store->io_lock, NULL);
+    pthread_cond_init(&store->wake, NULL);
+    pthread_cond_init(&store->synced, NULL);
+    store->spare = NULL;
+    store->spare_capacity = 0;
+    store->pending_records = 0;
+    store->sync_records = 0;
+    store->sync_window_ms = 0;
+    store->sync_waiters = 0;
+    store->durable_lsn = 0;
+}
+
+// Aplica à lista o efeito de um registro (usado ao carregar)
+void applyJournalRecord(TaskList *list, JournalRecordType type, int id, bool completed,
+                        const char *description, size_t length) {
+    Task *task = findTask(list, id);
+    switch (type) {
+        case JOURNAL_ADD:
+            if (task == NULL) {
+                task = createTaskWithLength(list, id, description, length);
+                attachTask(list, task);
+            }
+            setTaskCompleted(list, task, completed);
+            if (list->next_id <= id) {
+                list->next_id = id + 1;
+            }
+            break;
+        case JOURNAL_STATE:
+            if (task != NULL) {
+                setTaskCompleted(list, task, completed);
+            }
+            break;
+        case JOURNAL_REMOVE:
+            if (task != NULL) {
+                detachTask(list, task);
+                destroyTask(list, task);
+            }
+            break;
+        case JOURNAL_SCHEDULE:
+            if (task != NULL && length >= 5) {
+                int32_t due;
+                memcpy(&due, description + 1, 4);
+                setTaskSchedule(list, task, (signed char)description[0], due);
+            }
+            break;
+    }
+}
+
+// Tamanho do buffer de gravação do snapshot
+#define SNAPSHOT_BUFFER_SIZE (1 << 20)
+
+// Gravação do snapshot num descritor, com um buffer fornecido por quem chama
+typedef struct {
+    int fd;
+    char *data;  // SNAPSHOT_BUFFER_SIZE bytes
+    size_t used;
+    bool ok;     // false depois do primeiro erro de escrita
+} SnapshotWriter;
+
+// Acrescenta 'size' bytes ao snapshot, esvaziando o buffer quando enche
+void snapshotWrite(SnapshotWriter *writer, const void *data, size_t size) {
+    if (!writer->ok) {
+        return;
+    }
+    if (writer->used + size > SNAPSHOT_BUFFER_SIZE) {
+        writer->ok = writeAll(writer->fd, writer->data, writer->used);
+        writer->used = 0;
+        if (!writer->ok || size > SNAPSHOT_BUFFER_SIZE) {
+            writer->ok = writer->ok && writeAll(writer->fd, data, size);
+            return;
+        }
+    }
+    memcpy(writer->data + writer->used, data, size);
+    writer->used += size;
+}
+
+// Grava em 'path' o snapshot binário da lista, com o LSN 'lsn'
+// Formato: SnapshotHeader, vetor de SnapshotRecord (na ordem da lista) e o blob
+// com as descrições terminadas em '\0'
+// Só usa chamadas de sistema e o 'buffer' de SNAPSHOT_BUFFER_SIZE bytes (sem
+// stdio nem malloc), para poder rodar no processo filho da compactação em
+// segundo plano, criado por fork num processo com várias threads
+// Retorna false em erro, com errno indicando o motivo
+bool writeSnapshotFile(const TaskList *list, const char *path, uint64_t lsn, char *buffer) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+    header.lsn = lsn;
+    header.next_id = list->next_id;
+    for (const Task *t = list->head; t != NULL; t = t->next) {
+        header.count++;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    SnapshotWriter writer = { fd, buffer, 0, true };
+    snapshotWrite(&writer, &header, sizeof(header));
+
+    // Primeira passada: registros, com as posições das descrições no blob
+    uint64_t offset = 0;
+    for (const Task *t = list->head; t != NULL; t = t->next) {
+        SnapshotRecord record;
+        record.id = t->id;
+        record.flags = (t->completed ? 1 : 0) | (uint32_t)(uint8_t)t->priority << 8;
+        record.offset = offset;
+        record.length = (uint32_t)strlen(t->description);
+        record.due = t->due;
+        snapshotWrite(&writer, &record, sizeof(record));
+        offset += record.length + 1;
+    }
+    // Segunda passada: o blob de texto
+    for (const Task *t = list->head; t != NULL; t = t->next) {
+        snapshotWrite(&writer, t->description, strlen(t->description) + 1);
+    }
+    if (!writer.ok || !writeAll(fd, buffer, writer.used) || fsync(fd) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    return close(fd) == 0;
+}
+
+// Grava o snapshot da lista atual, substituindo o anterior de forma atômica
+void writeSnapshot(TaskStore *store) {
+    char *tmp_path = concatPath(store->snapshot_path, ".tmp");
+    uint64_t lsn = store->next_lsn - 1;
+    char *buffer = (char *)malloc(SNAPSHOT_BUFFER_SIZE);
+    if (!buffer) {
+        perror("Erro ao alocar memória para gravar o snapshot");
+        exit(EXIT_FAILURE);
+    }
+    if (!writeSnapshotFile(store->list, tmp_path, lsn, buffer)) {
+        perror(tmp_path);
+        exit(EXIT_FAILURE);
+    }
+    free(buffer);
+    if (rename(tmp_path, store->snapshot_path) != 0) {
+        perror(store->snapshot_path);
+        exit(EXIT_FAILURE);
+    }
+    syncDirectory(store->dir_path);
+    free(tmp_path);
+    store->snapshot_lsn = lsn;
+}
+
+// Carrega o snapshot (se existir) para a lista vazia, mapeando-o em memória
+// As descrições não são copiadas: as tarefas apontam direto para o blob
+// mapeado, que só é lido do disco quando a página é acessada. Estado e
+// ligações ficam no nó, então alterar uma tarefa nunca escreve no mapeamento
+bool loadSnapshot(TaskStore *store) {
+    TaskList *list = store->list;
+    int fd = open(store->snapshot_path, O_RDONLY);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            perror(store->snapshot_path);
+            exit(EXIT_FAILURE);
+        }
+        return true; // Ainda não há snapshot
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(store->snapshot_path);
+        exit(EXIT_FAILURE);
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // O mapeamento continua válido mesmo após a troca do arquivo
+    if (map == MAP_FAILED) {
+        perror(store->snapshot_path);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *base = (const char *)map;
+    const SnapshotHeader *header = (const SnapshotHeader *)base;
+    size_t records_end = sizeof(SnapshotHeader) + header->count * sizeof(SnapshotRecord);
+    // O último byte precisa ser um terminador para nenhuma descrição passar do fim
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, 8) != 0 ||
+        header->count > (size - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord) ||
+        (header->count > 0 && (records_end == size || base[size - 1] != '\0'))) {
+        munmap(map, size);
+        return false;
+    }
+    const SnapshotRecord *records = (const SnapshotRecord *)(base + sizeof(SnapshotHeader));
+    const char *blob = base + records_end;
+    size_t blob_size = size - records_end;
+
+    list->mapped = base;
+    list->mapped_size = size;
+    taskIndexReserve(&list->index, (size_t)header->count);
+    // Cada descrição termina no seu próprio NUL dentro do blob, e um ID
+    // repetido daria dois nós com a mesma chave no índice
+    // Na rejeição, os nós já ligados são liberados junto com a lista
+    for (uint64_t i = 0; i < header->count; i++) {
+        if (records[i].offset >= blob_size || blob_size - records[i].offset <= records[i].length ||
+            blob[records[i].offset + records[i].length] != '\0' ||
+            taskIndexFind(&list->index, records[i].id) != NULL) {
+            return false;
+        }
+        Task *task = allocTask(list, records[i].id);
+        task->completed = (records[i].flags & 1) != 0;
+        task->priority = (int8_t)((records[i].flags >> 8) & 0xFF);
+        task->due = records[i].due;
+        task->description = (char *)blob + records[i].offset;
+        attachTask(list, task);
+    }
+    list->next_id = header->next_id;
+    store->snapshot_lsn = header->lsn;
+    store->next_lsn = header->lsn + 1;
+    return true;
+}
+
+// Reaplica os registros do diário 'path' posteriores ao snapshot
+// Um registro incompleto ou corrompido no final (escrita interrompida) é descartado
+// Retorna quantos registros foram reaplicados
+size_t replayJournal(TaskStore *store, const char *path) {
+    size_t size;
+    unsigned char *data = readWholeFile(path, &size);
+    if (data == NULL) {
+        if (errno == ENOENT) {
+            return 0; // Ainda não há diário
+        }
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    size_t pos = 0;
+    size_t replayed = 0;
+    while (size - pos >= JOURNAL_HEADER_SIZE) {
+        uint32_t length, crc;
+        memcpy(&length, data + pos, 4);
+        memcpy(&crc, data + pos + 4, 4);
+        if (length < JOURNAL_FIXED_SIZE || size - pos - JOURNAL_HEADER_SIZE < length) {
+            break;
+        }
+        const unsigned char *payload = data + pos + JOURNAL_HEADER_SIZE;
+        if (crc32(payload, length) != crc) {
+            break;
+        }
+        uint64_t lsn;
+        int32_t id;
+        memcpy(&lsn, payload, 8);
+        memcpy(&id, payload + 12, 4);
+        if (lsn > store->snapshot_lsn) {
+            applyJournalRecord(store->list, (JournalRecordType)payload[8], id, payload[9] != 0,
+                               (const char *)payload + JOURNAL_FIXED_SIZE, length - JOURNAL_FIXED_SIZE);
+            replayed++;
+        }
+        if (lsn >= store->next_lsn) {
+            store->next_lsn = lsn + 1;
+        }
+        store->journal_records++;
+        pos += JOURNAL_HEADER_SIZE + length;
+    }
+    free(data);
+    if (pos < size && truncate(path, (off_t)pos) != 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return replayed;
+}
+
+// Grava um snapshot novo e esvazia o diário
+// Registros que sobrarem no diário após uma queda têm LSN já coberto pelo
+// snapshot e são ignorados na carga
+// Com a thread escritora, a escrita em andamento termina antes do truncamento;
+// o que ela ainda gravar depois também está coberto pelo snapshot
+void compactTaskStore(TaskStore *store) {
+    if (store->journal_fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&store->io_lock);
+    pthread_mutex_lock(&store->lock);
+    store->buffer_used = 0; // Registros ainda não gravados já estão cobertos pelo snapshot
+    store->pending_records = 0;
+    pthread_mutex_unlock(&store->lock);
+    writeSnapshot(store);
+    if (ftruncate(store->journal_fd, 0) != 0) {
+        perror(store->journal_path);
+        exit(EXIT_FAILURE);
+    }
+    store->journal_records = 0;
+    pthread_mutex_lock(&store->lock);
+    store->durable_lsn = store->snapshot_lsn;
+    pthread_cond_broadcast(&store->synced);
+    pthread_mutex_unlock(&store->lock);
+    pthread_mutex_unlock(&store->io_lock);
+}
+
+// Resultado do processo de compactação, recolhido pelo tratador de SIGCHLD
+// assim que ele termina, para que um servidor parado não guarde um zumbi
+// O único processo filho do programa é o da compactação
+static _Atomic int compaction_reaped = 0; // 1 = compaction_status tem o resultado
+static _Atomic int compaction_status = 0;
+
+void reapCompaction(int signal_number) {
+    (void)signal_number;
+    int saved = errno;
+    int status;
+    if (waitpid(-1, &status, WNOHANG) > 0) {
+        atomic_store(&compaction_status, status);
+        atomic_store(&compaction_reaped, 1);
+    }
+    errno = saved;
+}
+
+// Liga o tratador de SIGCHLD (uma vez, ao abrir o armazenamento)
+void installCompactionReaper(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = reapCompaction;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+}
+
+// Abre (ou cria) o armazenamento no diretório 'dir' e carrega a lista
+// Retorna false se o snapshot estiver corrompido
+bool openTaskStore(TaskStore *store, const char *dir, size_t compact_every) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror(dir);
+        exit(EXIT_FAILURE);
+    }
+    initCrc32Table();
+    store->dir_path = concatPath(dir, "");
+    store->snapshot_path = concatPath(dir, "/tarefas.snap");
+    store->journal_path = concatPath(dir, "/tarefas.journal");
+    store->next_journal_path = concatPath(dir, "/tarefas.journal.new");
+    store->compact_every = compact_every;
+    installCompactionReaper();
+
+    if (!loadSnapshot(store)) {
+        fprintf(stderr, "Snapshot corrompido: %s\n", store->snapshot_path);
+        return false;
+    }
+    // Uma compactação em segundo plano interrompida deixa os registros mais
+    // novos no segundo diário, que continua a sequência de LSNs do primeiro
+    size_t replayed = replayJournal(store, store->journal_path);
+    struct stat st;
+    bool interrupted = stat(store->next_journal_path, &st) == 0;
+    if (interrupted) {
+        replayed += replayJournal(store, store->next_journal_path);
+    }
+
+    store->journal_fd = open(store->journal_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (store->journal_fd < 0) {
+        perror(store->journal_path);
+        exit(EXIT_FAILURE);
+    }
+    store->durable_lsn = store->next_lsn - 1;
+    if (interrupted) {
+        // Junta tudo num snapshot novo antes de voltar a usar um único diário
+        compactTaskStore(store);
+        if (unlink(store->next_journal_path) != 0) {
+            perror(store->next_journal_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    size_t count = 0;
+    for (Task *t = store->list->head; t != NULL; t = t->next) {
+        count++;
+    }
+    notify("%zu tarefa(s) carregada(s) de '%s' (%zu registro(s) do diário reaplicado(s)).\n", count, dir, replayed);
+    return true;
+}
+
+// Conclui a compactação em segundo plano, se houver uma
+// Com 'wait', espera o processo terminar; sem, só verifica se já terminou
+// Depois que o snapshot novo entra no lugar (e a troca chega ao disco), o
+// segundo diário, só com os registros feitos durante a gravação, substitui o
+// primeiro. Uma queda entre as duas trocas deixa o snapshot novo com os dois
+// diários, e a carga ignora os registros já incluídos nele
+void finishBackgroundCompaction(TaskStore *store, bool wait) {
+    if (store->compaction_pid == 0) {
+        return;
+    }
+    int status = 0;
+    if (!atomic_load(&compaction_reaped)) {
+        pid_t done;
+        while ((done = waitpid(store->compaction_pid, &status, wait ? 0 : WNOHANG)) < 0 && errno == EINTR) {
+        }
+        if (done == 0) {
+            return; // Ainda gravando
+        }
+        if (done < 0 && errno == ECHILD) {
+            while (!atomic_load(&compaction_reaped)) {
+                sched_yield(); // O tratador, em outra thread, recolheu o processo agora
+            }
+        } else if (done < 0) {
+            perror("waitpid");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (atomic_exchange(&compaction_reaped, 0)) {
+        status = atomic_load(&compaction_status);
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Falha ao gravar o snapshot em segundo plano: %s\n", store->snapshot_path);
+        exit(EXIT_FAILURE);
+    }
+    store->compaction_pid = 0;
+    char *tmp_path = concatPath(store->snapshot_path, ".tmp");
+    if (rename(tmp_path, store->snapshot_path) != 0) {
+        perror(store->snapshot_path);
+        exit(EXIT_FAILURE);
+    }
+    free(tmp_path);
+    syncDirectory(store->dir_path);
+    if (rename(store->next_journal_path, store->journal_path) != 0) {
+        perror(store->journal_path);
+        exit(EXIT_FAILURE);
+    }
+    syncDirectory(store->dir_path);
+    store->snapshot_lsn = store->compaction_lsn;
+}
+
+// Começa uma compactação sem parar o processo por um tempo proporcional à lista
+// Um processo filho (fork) grava o snapshot a partir da sua cópia congelada da
+// memória; o sistema copia sob demanda as páginas que este processo alterar
+// enquanto isso. Os registros novos vão para um segundo diário, para que o
+// primeiro, já coberto pelo snapshot, seja descartado inteiro no final
+void startBackgroundCompaction(TaskStore *store) {
+    if (store->journal_fd < 0 || store->compaction_pid != 0) {
+        return;
+    }
+    int fd = open(store->next_journal_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        perror(store->next_journal_path);
+        exit(EXIT_FAILURE);
+    }
+    syncDirectory(store->dir_path);
+    // A escrita em andamento da thread escritora termina no diário antigo
+    pthread_mutex_lock(&store->io_lock);
+    int old_fd = store->journal_fd;
+    store->journal_fd = fd;
+    pthread_mutex_unlock(&store->io_lock);
+    close(old_fd);
+
+    store->compaction_lsn = store->next_lsn - 1;
+    char *tmp_path = concatPath(store->snapshot_path, ".tmp");
+    char *buffer = (char *)malloc(SNAPSHOT_BUFFER_SIZE);
+    if (!buffer) {
+        perror("Erro ao alocar memória para gravar o snapshot");
+        exit(EXIT_FAILURE);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        // Processo filho: outra thread pode ter ficado com uma trava do malloc
+        // ou do stdio no fork, então só chamadas de sistema; _exit também evita
+        // esvaziar de novo os buffers de stdio herdados
+        _exit(writeSnapshotFile(store->list, tmp_path, store->compaction_lsn, buffer) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    free(buffer);
+    free(tmp_path);
+    store->compaction_pid = pid;
+    store->journal_records = 0;
+}
+
+// Grava 'size' bytes de registros no diário e os torna duráveis
+void writeJournalData(TaskStore *store, const unsigned char *data, size_t size) {
+    pthread_mutex_lock(&store->io_lock);
+    if (!writeAll(store->journal_fd, data, size) || fdatasync(store->journal_fd) != 0) {
+        perror(store->journal_path);
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_unlock(&store->io_lock);
+}
+
+// Grava de uma vez os registros acumulados e os torna duráveis
+// Com a thread escritora, só os entrega a ela (sem esperar o disco), a menos
+// que já haja registros suficientes para acordá-la antes do fim da janela
+// Depois, compacta se o diário tiver atingido o limite
+void flushJournal(TaskStore *store) {
+    if (store->writer_running) {
+        pthread_mutex_lock(&store->lock);
+        if (store->pending_records > 0) {
+            pthread_cond_signal(&store->wake); // Começa a janela ou, cheia, grava já
+        }
+        pthread_mutex_unlock(&store->lock);
+    } else if (store->buffer_used > 0) {
+        writeJournalData(store, store->buffer, store->buffer_used);
+        store->buffer_used = 0;
+        store->pending_records = 0;
+        store->durable_lsn = store->next_lsn - 1;
+    }
+    finishBackgroundCompaction(store, false);
+    if (store->compact_every != 0 && store->journal_records >= store->compact_every) {
+        startBackgroundCompaction(store);
+    }
+}
+
+// Thread escritora: grava os registros pendentes em grupos, com um único
+// fdatasync por grupo. Um grupo sai quando a janela de 'sync_window_ms' se
+// esgota, quando junta 'sync_records' registros ou quando alguém chama journalSync
+void *runJournalWriter(void *arg) {
+    TaskStore *store = (TaskStore *)arg;
+    pthread_mutex_lock(&store->lock);
+    for (;;) {
+        while (store->buffer_used == 0 && !store->writer_stop) {
+            pthread_cond_wait(&store->wake, &store->lock);
+        }
+        if (store->buffer_used == 0) {
+            break; // Parada pedida e nada mais a gravar
+        }
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += store->sync_window_ms / 1000;
+        deadline.tv_nsec += (long)(store->sync_window_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!store->writer_stop && store->sync_waiters == 0 && store->pending_records < store->sync_records &&
+               pthread_cond_timedwait(&store->wake, &store->lock, &deadline) != ETIMEDOUT) {
+        }
+        if (store->buffer_used == 0) {
+            continue; // Uma compactação cobriu os registros enquanto esperava
+        }
+        // Troca os buffers: quem registra ações continua no outro enquanto este é gravado
+        unsigned char *data = store->buffer;
+        size_t size = store->buffer_used;
+        size_t capacity = store->buffer_capacity;
+        uint64_t lsn = store->next_lsn - 1;
+        store->buffer = store->spare;
+        store->buffer_capacity = store->spare_capacity;
+        store->buffer_used = 0;
+        store->pending_records = 0;
+        pthread_mutex_unlock(&store->lock);
+
+        writeJournalData(store, data, size);
+
+        pthread_mutex_lock(&store->lock);
+        store->spare = data;
+        store->spare_capacity = capacity;
+        if (lsn > store->durable_lsn) {
+            store->durable_lsn = lsn;
+        }
+        pthread_cond_broadcast(&store->synced);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return NULL;
+}
+
+// Liga a gravação em segundo plano: os registros ficam no máximo 'window_ms'
+// (ou até somarem 'records') sem chegar ao disco
+// Com 'window_ms' = 0, cada gravação continua durável antes de retornar
+void startJournalWriter(TaskStore *store, unsigned int window_ms, size_t records) {
+    if (store->journal_fd < 0 || window_ms == 0) {
+        return;
+    }
+    store->sync_window_ms = window_ms;
+    store->sync_records = records > 0 ? records : 1;
+    store->writer_stop = false;
+    if (pthread_create(&store->writer, NULL, runJournalWriter, store) != 0) {
+        fprintf(stderr, "Não foi possível iniciar a gravação do diário em segundo plano\n");
+        exit(EXIT_FAILURE);
+    }
+    store->writer_running = true;
+}
+
+// Grava o que estiver pendente e desliga a thread escritora
+void stopJournalWriter(TaskStore *store) {
+    if (!store->writer_running) {
+        return;
+    }
+    pthread_mutex_lock(&store->lock);
+    store->writer_stop = true;
+    pthread_cond_signal(&store->wake);
+    pthread_mutex_unlock(&store->lock);
+    pthread_join(store->writer, NULL);
+    store->writer_running = false;
+}
+
+// Barreira de durabilidade: retorna quando todos os registros feitos até
+// agora estão no disco. Pode ser chamada de qualquer thread
+void journalSync(TaskStore *store) {
+    if (store == NULL || !store->writer_running) {
+        return; // Sem a thread escritora, cada registro já é durável ao ser feito
+    }
+    pthread_mutex_lock(&store->lock);
+    uint64_t target = store->next_lsn - 1;
+    store->sync_waiters++;
+    pthread_cond_signal(&store->wake);
+    while (store->durable_lsn < target) {
+        pthread_cond_wait(&store->synced, &store->lock);
+    }
+    store->sync_waiters--;
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Inicia um lote: os registros seguintes são gravados juntos, com um único
+// fdatasync, no journalEndBatch correspondente
+void journalBeginBatch(TaskStore *store) {
+    if (store != NULL) {
+        store->batch_depth++;
+    }
+}
+
+// Encerra um lote, gravando os registros acumulados
+void journalEndBatch(TaskStore *store) {
+    if (store != NULL && --store->batch_depth == 0 && store->journal_fd >= 0) {
+        flushJournal(store);
+    }
+}
+
+// Acrescenta um registro ao diário
+// Fora de um lote, o registro é durável antes de a função retornar (ou, com a
+// thread escritora, entregue a ela sem esperar o disco)
+void journalAppendData(TaskStore *store, JournalRecordType type, int id, bool completed,
+                       const void *data, size_t length) {
+    if (store == NULL || store->journal_fd < 0) {
+        return;
+    }
+    size_t payload = JOURNAL_FIXED_SIZE + length;
+    pthread_mutex_lock(&store->lock); // A escritora pode estar trocando os buffers
+    reserveStoreBuffer(store, JOURNAL_HEADER_SIZE + payload);
+
+    unsigned char *record = store->buffer + store->buffer_used;
+    unsigned char *p = record + JOURNAL_HEADER_SIZE;
+    uint64_t lsn = store->next_lsn++;
+    int32_t id32 = id;
+    memcpy(p, &lsn, 8);
+    p[8] = (unsigned char)type;
+    p[9] = completed ? 1 : 0;
+    p[10] = 0;
+    p[11] = 0;
+    memcpy(p + 12, &id32, 4);
+    if (length > 0) {
+        memcpy(p + JOURNAL_FIXED_SIZE, data, length);
+    }
+    uint32_t size32 = (uint32_t)payload;
+    uint32_t crc = crc32(p, payload);
+    memcpy(record, &size32, 4);
+    memcpy(record + 4, &crc, 4);
+    store->buffer_used += JOURNAL_HEADER_SIZE + payload;
+    store->pending_records++;
+    pthread_mutex_unlock(&store->lock);
+    store->journal_records++;
+
+    if (store->batch_depth == 0) {
+        flushJournal(store);
+    }
+}
+
+// Acrescenta um registro cujo dado é uma descrição terminada em '\0' (ou NULL)
+void journalAppend(TaskStore *store, JournalRecordType type, int id, bool completed, const char *description) {
+    journalAppendData(store, type, id, completed, description, description ? strlen(description) : 0);
+}
+
+// Registra no diário a prioridade e o prazo atuais de uma tarefa
+void journalSchedule(TaskStore *store, const Task *task) {
+    unsigned char data[5];
+    data[0] = (unsigned char)task->priority;
+    memcpy(data + 1, &task->due, 4);
+    journalAppendData(store, JOURNAL_SCHEDULE, task->id, task->completed, data, sizeof(data));
+}
+
+// Registra no diário a presença atual de uma tarefa (inserção com estado e
+// descrição, seguida da prioridade e do prazo quando não forem os padrões)
+void journalTask(TaskStore *store, const Task *task) {
+    journalAppend(store, JOURNAL_ADD, task->id, task->completed, task->description);
+    if (task->priority != 0 || task->due != 0) {
+        journalSchedule(store, task);
+    }
+}
+
+// Compacta uma última vez e fecha o armazenamento
+void closeTaskStore(TaskStore *store) {
+    stopJournalWriter(store);
+    finishBackgroundCompaction(store, true);
+    if (store->journal_fd >= 0) {
+        if (store->journal_records > 0 || store->buffer_used > 0) {
+            compactTaskStore(store);
+        }
+        close(store->journal_fd);
+    }
+    free(store->dir_path);
+    free(store->journal_path);
+    free(store->snapshot_path);
+    free(store->next_journal_path);
+    free(store->buffer);
+    free(store->spare);
+    pthread_mutex_destroy(&store->lock);
+    pthread_mutex_destroy(&store->io_lock);
+    pthread_cond_destroy(&store->wake);
+    pthread_cond_destroy(&store->synced);
+    initTaskStore(store, store->list);
+}
+
+// --- Funções da Pilha de Ações (Histórico - para Desfazer) ---
+
+// Maior tamanho de um registro codificado do histórico
+#define ACTION_RECORD_MAX 48
+
+// Bits da etiqueta de um registro do histórico (os 4 bits baixos são o tipo)
+#define ACTION_TAG_COMPLETED 0x10 // Action::was_completed
+#define ACTION_TAG_TASK 0x20      // Há um ponteiro em Action::task
+#define ACTION_TAG_BITS 0x40      // Há um ponteiro em Action::bits
+
+// Inicializa a pilha de ações
+// 'max_depth' limita quantas ações são lembradas (0 = sem limite)
+// Os nós guardados no histórico pertencem aos alocadores da lista
+void initActionStack(ActionStack *stack, TaskList *list, size_t max_depth) {
+    stack->log = NULL;
+    stack->start = 0;
+    stack->used = 0;
+    stack->capacity = 0;
+    stack->count = 0;
+    stack->base_id = 0;
+    stack->last_id = 0;
+    stack->max_depth = max_depth;
+    stack->list = list;
+}
+
+// Ação de um tipo com os campos opcionais vazios
+Action makeAction(ActionType type, int task_id, bool was_completed) {
+    Action action;
+    action.type = type;
+    action.task_id = task_id;
+    action.count = 1;
+    action.due = 0;
+    action.was_completed = was_completed;
+    action.priority = 0;
+    action.task = NULL;
+    action.bits = NULL;
+    return action;
+}
+
+// Escreve 'value' em varint (7 bits por byte); retorna o número de bytes
+size_t putVarint(unsigned char *p, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        p[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    p[n++] = (unsigned char)value;
+    return n;
+}
+
+// Lê um varint, avançando '*p'
+uint64_t getVarint(const unsigned char **p) {
+    uint64_t value = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = *(*p)++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// Codificação zigzag: números pequenos, positivos ou negativos, viram varints curtos
+uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Indica se o tipo guarda a quantidade de IDs (Action::count)
+bool actionHasCount(ActionType type) {
+    return type == ACTION_IMPORT || type == ACTION_COMPLETE_SET || type == ACTION_REMOVE_SET;
+}
+
+// Codifica uma ação em 'out' (ACTION_RECORD_MAX bytes), com o ID relativo a 'prev_id'
+// Retorna o tamanho do registro, incluindo o byte final com o tamanho do corpo
+size_t encodeAction(const Action *action, int prev_id, unsigned char *out) {
+    unsigned char *p = out;
+    *p++ = (unsigned char)(action->type | (action->was_completed ? ACTION_TAG_COMPLETED : 0) |
+                           (action->task != NULL ? ACTION_TAG_TASK : 0) | (action->bits != NULL ? ACTION_TAG_BITS : 0));
+    p += putVarint(p, zigzag((int64_t)action->task_id - prev_id));
+    if (actionHasCount(action->type)) {
+        p += putVarint(p, (uint64_t)(uint32_t)action->count);
+    }
+    if (action->type == ACTION_SCHEDULE) {
+        *p++ = (unsigned char)action->priority;
+        p += putVarint(p, zigzag(action->due));
+    }
+    if (action->task != NULL) {
+        memcpy(p, &action->task, sizeof(Task *));
+        p += sizeof(Task *);
+    }
+    if (action->bits != NULL) {
+        memcpy(p, &action->bits, sizeof(uint64_t *));
+        p += sizeof(uint64_t *);
+    }
+    *p = (unsigned char)(p - out);
+    return (size_t)(p - out) + 1;
+}
+
+// Decodifica o registro que começa em 'p'; o ID sai relativo ao registro
+// anterior, em '*delta' (action->task_id fica para quem chama)
+// Retorna o tamanho do registro
+size_t decodeAction(const unsigned char *p, Action *action, int64_t *delta) {
+    const unsigned char *start = p;
+    unsigned char tag = *p++;
+    *action = makeAction((ActionType)(tag & 0x0F), 0, (tag & ACTION_TAG_COMPLETED) != 0);
+    *delta = unzigzag(getVarint(&p));
+    if (actionHasCount(action->type)) {
+        action->count = (int)getVarint(&p);
+    }
+    if (action->type == ACTION_SCHEDULE) {
+        action->priority = (int8_t)*p++;
+        action->due = (int32_t)unzigzag(getVarint(&p));
+    }
+    if (tag & ACTION_TAG_TASK) {
+        memcpy(&action->task, p, sizeof(Task *));
+        p += sizeof(Task *);
+    }
+    if (tag & ACTION_TAG_BITS) {
+        memcpy(&action->bits, p, sizeof(uint64_t *));
+        p += sizeof(uint64_t *);
+    }
+    return (size_t)(p - start) + 1;
+}
+
+// Percorre as ações da pilha da mais antiga para a mais recente
+// 'pos' e 'id' começam em stack->start e stack->base_id
+// Retorna false depois da última
+bool nextStackedAction(const ActionStack *stack, size_t *pos, int *id, Action *action) {
+    if (*pos >= stack->used) {
+        return false;
+    }
+    int64_t delta;
+    *pos += decodeAction(stack->log + *pos, action, &delta);
+    *id = (int)(*id + delta);
+    action->task_id = *id;
+    return true;
+}
+
+// Devolve à lista os nós de tarefa que uma ação ainda possuir
+void releaseAction(ActionStack *stack, Action *action) {
+    free(action->bits);
+    action->bits = NULL;
+    while (action->task) {
+        Task *next = action->task->next;
+        destroyTask(stack->list, action->task);
+        action->task = next;
+    }
+}
+
+// Empilha uma ação, descartando a mais antiga se a pilha estiver cheia
+// Os nós e o bitset da ação passam a pertencer à pilha
+void pushAction(ActionStack *stack, const Action *action) {
+    if (stack->max_depth != 0 && stack->count >= stack->max_depth) {
+        // Pilha cheia: a ação mais antiga é esquecida
+        Action oldest;
+        size_t pos = stack->start;
+        nextStackedAction(stack, &pos, &stack->base_id, &oldest);
+        releaseAction(stack, &oldest);
+        stack->start = pos;
+        stack->count--;
+    }
+    if (stack->capacity - stack->used < ACTION_RECORD_MAX) {
+        if (stack->start >= stack->capacity / 2 && stack->start > 0) {
+            // Metade do log é de registros descartados: desloca o resto para o início
+            memmove(stack->log, stack->log + stack->start, stack->used - stack->start);
+            stack->used -= stack->start;
+            stack->start = 0;
+        } else {
+            size_t new_capacity = stack->capacity ? stack->capacity * 2 : 1024;
+            unsigned char *log = (unsigned char *)realloc(stack->log, new_capacity);
+            if (!log) {
+                perror("Erro ao alocar memória para o histórico de ações");
+                exit(EXIT_FAILURE);
+            }
+            stack->log = log;
+            stack->capacity = new_capacity;
+        }
+    }
+    stack->used += encodeAction(action, stack->last_id, stack->log + stack->used);
+    stack->last_id = action->task_id;
+    stack->count++;
+}
+
+// Desempilha a ação do topo para '*action', decodificando-a a partir do fim do log
+// A posse dos nós e do bitset passa para quem chama
+// Retorna false se a pilha estiver vazia
+bool popAction(ActionStack *stack, Action *action) {
+    if (stack->count == 0) {
+        return false; // Pilha vazia
+    }
+    size_t length = (size_t)stack->log[stack->used - 1] + 1;
+    int64_t delta;
+    stack->used -= length;
+    decodeAction(stack->log + stack->used, action, &delta);
+    action->task_id = stack->last_id;
+    stack->last_id = (int)(stack->last_id - delta);
+    if (--stack->count == 0) {
+        stack->start = 0;
+        stack->used = 0;
+    }
+    return true;
+}
+
+// Esvazia a pilha, devolvendo à lista os nós que as ações possuírem
+void clearActionStack(ActionStack *stack) {
+    size_t pos = stack->start;
+    int id = stack->base_id;
+    Action action;
+    while (nextStackedAction(stack, &pos, &id, &action)) {
+        releaseAction(stack, &action);
+    }
+    stack->start = 0;
+    stack->used = 0;
+    stack->count = 0;
+    stack->base_id = stack->last_id;
+}
+
+// Libera toda a memória da pilha de ações
+// As tarefas guardadas ficam com os alocadores da lista de tarefas, que as
+// liberam no destroyTaskList; só os bitsets das ações são liberados aqui
+void destroyActionStack(ActionStack *stack) {
+    size_t pos = stack->start;
+    int id = stack->base_id;
+    Action action;
+    while (nextStackedAction(stack, &pos, &id, &action)) {
+        free(action.bits);
+    }
+    free(stack->log);
+    initActionStack(stack, stack->list, stack->max_depth);
+}
+
+// --- Funções do Histórico (Desfazer/Refazer) ---
+
+// Inicializa as pilhas de desfazer e refazer com a mesma profundidade máxima
+// 'store' recebe o efeito de cada ação registrada, desfeita ou refeita (pode ser NULL)
+void initHistory(History *history, TaskList *list, size_t max_depth, TaskStore *store) {
+    initActionStack(&history->undo, list, max_depth);
+    initActionStack(&history->redo, list, max_depth);
+    history->store = store;
+}
+
+// Grava no diário o efeito de uma ação que acabou de ser feita (undo=false),
+// desfeita (undo=true) ou refeita (undo=false)
+void journalAction(History *history, const Action *action, bool undo) {
+    if (history->store == NULL) {
+        return;
+    }
+    TaskList *list = history->undo.list;
+    switch (action->type) {
+        case ACTION_ADD:
+        case ACTION_REMOVE: {
+            // Desfazer um ADD ou fazer um REMOVE tira a tarefa da lista; o contrário a devolve
+            bool present = (action->type == ACTION_ADD) != undo;
+            if (present) {
+                journalTask(history->store, findTask(list, action->task_id));
+            } else {
+                journalAppend(history->store, JOURNAL_REMOVE, action->task_id, false, NULL);
+            }
+            break;
+        }
+        case ACTION_COMPLETE:
+            journalAppend(history->store, JOURNAL_STATE, action->task_id, undo ? action->was_completed : true, NULL);
+            break;
+        case ACTION_IMPORT:
+            // Um lote de registros, gravado com uma única sincronização
+            // Ao desfazer, os nós retirados estão encadeados na própria ação
+            journalBeginBatch(history->store);
+            if (undo) {
+                for (const Task *task = action->task; task != NULL; task = task->next) {
+                    journalAppend(history->store, JOURNAL_REMOVE, task->id, false, NULL);
+                }
+            } else {
+                for (int i = 0; i < action->count; i++) {
+                    Task *task = findTask(list, action->task_id + i);
+                    if (task != NULL) {
+                        journalTask(history->store, task);
+                    }
+                }
+            }
+            journalEndBatch(history->store);
+            break;
+        case ACTION_COMPLETE_SET:
+        case ACTION_REMOVE_SET: {
+            journalBeginBatch(history->store);
+            IdSetCursor cursor;
+            initIdSetCursor(&cursor, action->task_id, action->task_id + action->count - 1, action->bits);
+            int id;
+            while (idSetNext(&cursor, &id)) {
+                if (action->type == ACTION_COMPLETE_SET) {
+                    journalAppend(history->store, JOURNAL_STATE, id, !undo, NULL);
+                } else if (undo) {
+                    Task *task = findTask(list, id);
+                    if (task != NULL) {
+                        journalTask(history->store, task);
+                    }
+                } else {
+                    journalAppend(history->store, JOURNAL_REMOVE, id, false, NULL);
+                }
+            }
+            journalEndBatch(history->store);
+            break;
+        }
+        case ACTION_SCHEDULE:
+            journalSchedule(history->store, findTask(list, action->task_id));
+            break;
+    }
+}
+
+// Empilha uma ação recém-feita e a grava no diário; qualquer ação desfeita
+// deixa de poder ser refeita
+void recordNewAction(History *history, const Action *action) {
+    COUNT(COUNTER_ACTIONS, 1);
+    clearActionStack(&history->redo);
+    pushAction(&history->undo, action);
+    journalAction(history, action, false);
+}
+
+// Registra uma nova ação
+void recordAction(History *history, ActionType type, int task_id, bool was_completed) {
+    Action action = makeAction(type, task_id, was_completed);
+    recordNewAction(history, &action);
+}
+
+// Registra uma importação em lote como uma única ação composta
+void recordImport(History *history, int first_id, int count) {
+    Action action = makeAction(ACTION_IMPORT, first_id, false);
+    action.count = count;
+    recordNewAction(history, &action);
+}
+
+// Registra uma operação sobre um conjunto de IDs como uma única ação composta
+// A ação passa a ser dona do bitset de 'set' e, para REMOVE_SET, da cadeia
+// de nós removidos
+void recordSet(History *history, ActionType type, IdSet *set, Task *removed) {
+    Action action = makeAction(type, set->first, false);
+    action.count = set->last - set->first + 1;
+    action.bits = set->bits;
+    action.task = removed;
+    set->bits = NULL;
+    recordNewAction(history, &action);
+}
+
+// Registra a mudança de prioridade ou prazo de uma tarefa, guardando os valores anteriores
+void recordSchedule(History *history, int task_id, int old_priority, int32_t old_due) {
+    Action action = makeAction(ACTION_SCHEDULE, task_id, false);
+    action.priority = (int8_t)old_priority;
+    action.due = old_due;
+    recordNewAction(history, &action);
+}
+
+// Registra a remoção de uma tarefa, transferindo o nó (e sua descrição) para
+// o histórico; o desfazer reencadeia o mesmo nó, sem cópia
+void recordRemove(History *history, Task *removed) {
+    Action action = makeAction(ACTION_REMOVE, removed->id, removed->completed);
+    action.task = removed;
+    recordNewAction(history, &action);
+}
+
+// Libera toda a memória do histórico
+void destroyHistory(History *history) {
+    destroyActionStack(&history->undo);
+    destroyActionStack(&history->redo);
+    notify("Toda a memória do histórico de ações foi liberada.\n");
+}
+
+// Memória ocupada pelo log de uma pilha e pelos bitsets das ações
+// (os nós de tarefa guardados nas ações não entram na conta)
+size_t actionStackBytes(const ActionStack *stack) {
+    size_t bytes = stack->capacity;
+    size_t pos = stack->start;
+    int id = stack->base_id;
+    Action action;
+    while (nextStackedAction(stack, &pos, &id, &action)) {
+        if (action.bits != NULL) {
+            bytes += idSetWords(action.task_id, action.task_id + action.count - 1) * sizeof(uint64_t);
+        }
+    }
+    return bytes;
+}
+
+// Mostra os contadores de instrumentação e o tamanho do histórico de quem pediu
+void printCounters(const History *history) {
+    report("\n--- Contadores ---\n");
+#ifdef TAREFA_NO_COUNTERS
+    report("Contadores desligados na compilação (TAREFA_NO_COUNTERS)\n");
+#else
+    uint64_t actions = counterTotal(COUNTER_ACTIONS);
+    uint64_t lookups = counterTotal(COUNTER_LOOKUPS);
+    uint64_t allocs = counterTotal(COUNTER_NODE_ALLOCS) + counterTotal(COUNTER_TEXT_ALLOCS);
+    uint64_t listed = counterTotal(COUNTER_LISTED);
+    uint64_t ticks = counterTotal(COUNTER_LISTING_TICKS);
+    report("Comandos: %llu | Ações registradas: %llu\n", (unsigned long long)counterTotal(COUNTER_COMMANDS),
+           (unsigned long long)actions);
+    report("Buscas por ID: %llu (%.2f entradas do índice por busca)\n", (unsigned long long)lookups,
+           lookups ? (double)counterTotal(COUNTER_PROBES) / (double)lookups : 0.0);
+    report("Alocações: %llu nós, %llu textos, %llu malloc (%.2f por ação)\n",
+           (unsigned long long)counterTotal(COUNTER_NODE_ALLOCS), (unsigned long long)counterTotal(COUNTER_TEXT_ALLOCS),
+           (unsigned long long)counterTotal(COUNTER_MALLOCS), actions ? (double)allocs / (double)actions : 0.0);
+    report("Listagens: %llu (%llu linhas, %llu %s, %.1f por linha)\n", (unsigned long long)counterTotal(COUNTER_LISTINGS),
+           (unsigned long long)listed, (unsigned long long)ticks, COUNTER_TICK_UNIT,
+           listed ? (double)ticks / (double)listed : 0.0);
+#endif
+    report("Histórico: %zu para desfazer, %zu para refazer (%zu bytes)\n", history->undo.count, history->redo.count,
+           actionStackBytes(&history->undo) + actionStackBytes(&history->redo));
+    report("--------------------\n");
+}
+
+// Escreve os contadores numa linha 'chave=valor' legível por máquina
+void dumpCounters(FILE *stream, const History *history) {
+    flockfile(stream); // A linha não se mistura com a de outra thread
+    fprintf(stream, "stats");
+    for (int counter = 0; counter < COUNTER_COUNT; counter++) {
+        fprintf(stream, " %s=%llu", counter_names[counter], (unsigned long long)counterTotal((Counter)counter));
+    }
+    fprintf(stream, " undo_depth=%zu redo_depth=%zu history_bytes=%zu\n", history->undo.count, history->redo.count,
+            actionStackBytes(&history->undo) + actionStackBytes(&history->redo));
+    fflush(stream);
+    funlockfile(stream);
+}
+
+// --- Funções Desfazer/Refazer ---
+
+// Troca a prioridade e o prazo de uma tarefa pelos guardados numa ação SCHEDULE,
+// que passa a guardar os valores que a tarefa tinha (para a operação inversa)
+void swapSchedule(TaskList *taskList, Task *task, Action *action) {
+    int priority = task->priority;
+    int32_t due = task->due;
+    setTaskSchedule(taskList, task, action->priority, action->due);
+    action->priority = (int8_t)priority;
+    action->due = due;
+}
+
+// Aplica o estado 'completed' às tarefas de uma ação COMPLETE_SET que ainda
+// existirem; retorna quantas mudaram
+int applySetState(TaskList *taskList, const Action *action, bool completed) {
+    IdSetCursor cursor;
+    initIdSetCursor(&cursor, action->task_id, action->task_id + action->count - 1, action->bits);
+    int changed = 0;
+    int id;
+    while (idSetNext(&cursor, &id)) {
+        Task *task = findTask(taskList, id);
+        if (task != NULL && task->completed != completed) {
+            setTaskCompleted(taskList, task, completed);
+            changed++;
+        }
+    }
+    return changed;
+}
+
+// Reverte uma ação sobre a lista
+// Nós retirados da lista passam a pertencer à ação (para um futuro Refazer)
+// Retorna false se a tarefa envolvida não existir mais
+bool revertAction(TaskList *taskList, Action *action, bool verbose) {
+    switch (action->type) {
+        case ACTION_ADD: {
+            // Se a ação foi ADICIONAR, tira da lista a tarefa que foi adicionada.
+            Task *current = findTask(taskList, action->task_id);
+            if (current == NULL) {
+                report("Erro ao desfazer: Tarefa adicionada (ID: %d) não encontrada para remoção.\n", action->task_id);
+                return false;
+            }
+            detachTask(taskList, current);
+            action->task = current; // Guardada para poder ser refeita
+            if (verbose) {
+                notify("Desfeito: Tarefa (ID: %d) removida (originalmente adicionada).\n", action->task_id);
+            }
+            return true;
+        }
+        case ACTION_COMPLETE: {
+            // Se a ação foi CONCLUIR, reverte o estado de conclusão da tarefa.
+            Task *current = findTask(taskList, action->task_id);
+            if (current == NULL) {
+                report("Erro ao desfazer: Tarefa concluída (ID: %d) não encontrada para reverter.\n", action->task_id);
+                return false;
+            }
+            setTaskCompleted(taskList, current, action->was_completed);
+            if (verbose) {
+                notify("Desfeito: Tarefa (ID: %d) estado revertido para %s.\n", action->task_id, action->was_completed ? "concluída" : "pendente");
+            }
+            return true;
+        }
+        case ACTION_REMOVE: {
+            // Se a ação foi REMOVER, adiciona a tarefa de volta.
+            // O nó removido (com descrição e estado originais) volta para o final da lista.
+            Task *readdedTask = action->task;
+            action->task = NULL; // A posse do nó volta para a lista
+            attachTask(taskList, readdedTask);
+            // Assegura que o next_id não seja menor que um ID já usado
+            if (taskList->next_id <= action->task_id) {
+                 taskList->next_id = action->task_id + 1;
+            }
+            if (verbose) {
+                notify("Desfeito: Tarefa '%s' (ID: %d) adicionada novamente.\n", readdedTask->description, readdedTask->id);
+            }
+            return true;
+        }
+        case ACTION_IMPORT: {
+            // Retira da lista as tarefas importadas que ainda existirem,
+            // encadeando-as na ação em ordem crescente de ID
+            Task *last = NULL;
+            int removed = 0;
+            for (int i = 0; i < action->count; i++) {
+                Task *current = findTask(taskList, action->task_id + i);
+                if (current == NULL) {
+                    continue; // Removida depois da importação
+                }
+                detachTask(taskList, current);
+                if (last == NULL) {
+                    action->task = current;
+                } else {
+                    last->next = current;
+                }
+                last = current;
+                removed++;
+            }
+            if (removed == 0) {
+                report("Erro ao desfazer: Nenhuma tarefa importada (IDs %d a %d) encontrada.\n", action->task_id, action->task_id + action->count - 1);
+                return false;
+            }
+            if (verbose) {
+                notify("Desfeito: importação de %d tarefa(s) (IDs %d a %d) removida.\n", removed, action->task_id, action->task_id + action->count - 1);
+            }
+            return true;
+        }
+        case ACTION_COMPLETE_SET: {
+            // Volta para pendentes as tarefas que o conjunto concluiu
+            int changed = applySetState(taskList, action, false);
+            if (changed == 0) {
+                report("Erro ao desfazer: Nenhuma tarefa do conjunto (IDs %d a %d) encontrada.\n", action->task_id, action->task_id + action->count - 1);
+                return false;
+            }
+            if (verbose) {
+                notify("Desfeito: %d tarefa(s) voltaram a ficar pendentes.\n", changed);
+            }
+            return true;
+        }
+        case ACTION_REMOVE_SET: {
+            // Os nós removidos voltam, em ordem de ID, para o final da lista.
+            int restored = 0;
+            while (action->task != NULL) {
+                Task *readdedTask = action->task;
+                action->task = readdedTask->next;
+                attachTask(taskList, readdedTask);
+                if (taskList->next_id <= readdedTask->id) {
+                    taskList->next_id = readdedTask->id + 1;
+                }
+                restored++;
+            }
+            if (verbose) {
+                notify("Desfeito: %d tarefa(s) adicionada(s) novamente.\n", restored);
+            }
+            return true;
+        }
+        case ACTION_SCHEDULE: {
+            Task *current = findTask(taskList, action->task_id);
+            if (current == NULL) {
+                report("Erro ao desfazer: Tarefa (ID: %d) não encontrada para restaurar a prioridade.\n", action->task_id);
+                return false;
+            }
+            swapSchedule(taskList, current, action);
+            if (verbose) {
+                notify("Desfeito: Tarefa (ID: %d) voltou à prioridade %d.\n", action->task_id, current->priority);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Aplica novamente uma ação desfeita
+// Retorna false se a tarefa envolvida não existir mais
+bool reapplyAction(TaskList *taskList, Action *action, bool verbose) {
+    switch (action->type) {
+        case ACTION_ADD: {
+            // O nó retirado pelo Desfazer volta para o final da lista.
+            Task *readdedTask = action->task;
+            action->task = NULL;
+            attachTask(taskList, readdedTask);
+            if (verbose) {
+                notify("Refeito: Tarefa '%s' (ID: %d) adicionada novamente.\n", readdedTask->description, readdedTask->id);
+            }
+            return true;
+        }
+        case ACTION_COMPLETE: {
+            Task *current = findTask(taskList, action->task_id);
+            if (current == NULL) {
+                report("Erro ao refazer: Tarefa (ID: %d) não encontrada para concluir.\n", action->task_id);
+                return false;
+            }
+            setTaskCompleted(taskList, current, true);
+            if (verbose) {
+                notify("Refeito: Tarefa %d marcada como concluída.\n", action->task_id);
+            }
+            return true;
+        }
+        case ACTION_REMOVE: {
+            Task *current = findTask(taskList, action->task_id);
+            if (current == NULL) {
+                report("Erro ao refazer: Tarefa (ID: %d) não encontrada para remoção.\n", action->task_id);
+                return false;
+            }
+            detachTask(taskList, current);
+            action->task = current; // Guardada para um novo Desfazer
+            if (verbose) {
+                notify("Refeito: Tarefa %d ('%s') removida.\n", current->id, current->description);
+            }
+            return true;
+        }
+        case ACTION_IMPORT: {
+            // Os nós guardados pelo Desfazer voltam, na ordem original, para o final da lista.
+            int restored = 0;
+            while (action->task != NULL) {
+                Task *readdedTask = action->task;
+                action->task = readdedTask->next;
+                attachTask(taskList, readdedTask);
+                restored++;
+            }
+            if (verbose) {
+                notify("Refeito: importação de %d tarefa(s) (IDs %d a %d) restaurada.\n", restored, action->task_id, action->task_id + action->count - 1);
+            }
+            return true;
+        }
+        case ACTION_COMPLETE_SET: {
+            int changed = applySetState(taskList, action, true);
+            if (changed == 0) {
+                report("Erro ao refazer: Nenhuma tarefa do conjunto (IDs %d a %d) encontrada.\n", action->task_id, action->task_id + action->count - 1);
+                return false;
+            }
+            if (verbose) {
+                notify("Refeito: %d tarefa(s) marcadas como concluídas.\n", changed);
+            }
+            return true;
+        }
+        case ACTION_REMOVE_SET: {
+            // Retira de novo as tarefas do conjunto que ainda estiverem na lista
+            IdSetCursor cursor;
+            initIdSetCursor(&cursor, action->task_id, action->task_id + action->count - 1, action->bits);
+            Task *last = NULL;
+            int removed = 0;
+            int id;
+            while (idSetNext(&cursor, &id)) {
+                Task *current = findTask(taskList, id);
+                if (current == NULL) {
+                    continue;
+                }
+                detachTask(taskList, current);
+                if (last == NULL) {
+                    action->task = current;
+                } else {
+                    last->next = current;
+                }
+                last = current;
+                removed++;
+            }
+            if (removed == 0) {
+                report("Erro ao refazer: Nenhuma tarefa do conjunto (IDs %d a %d) encontrada.\n", action->task_id, action->task_id + action->count - 1);
+                return false;
+            }
+            if (verbose) {
+                notify("Refeito: %d tarefa(s) removida(s).\n", removed);
+            }
+            return true;
+        }
+        case ACTION_SCHEDULE: {
+            Task *current = findTask(taskList, action->task_id);
+            if (current == NULL) {
+                report("Erro ao refazer: Tarefa (ID: %d) não encontrada para mudar a prioridade.\n", action->task_id);
+                return false;
+            }
+            swapSchedule(taskList, current, action);
+            if (verbose) {
+                notify("Refeito: Tarefa %d com prioridade %d.\n", action->task_id, current->priority);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Move até 'count' ações de uma pilha para a outra, desfazendo-as (undo=true)
+// ou refazendo-as. Cada registro é decodificado do topo de uma pilha e
+// codificado de novo no topo da outra; registros cuja tarefa não existe mais
+// são descartados
+// Retorna quantas ações foram aplicadas
+size_t replayHistory(TaskList *taskList, History *history, bool undo, size_t count, bool verbose) {
+    ActionStack *from = undo ? &history->undo : &history->redo;
+    ActionStack *to = undo ? &history->redo : &history->undo;
+    size_t applied = 0;
+
+    Action action;
+    while (applied < count && popAction(from, &action)) {
+        bool ok = undo ? revertAction(taskList, &action, verbose) : reapplyAction(taskList, &action, verbose);
+        if (ok) {
+            journalAction(history, &action, undo);
+            pushAction(to, &action);
+            applied++;
+        } else {
+            releaseAction(from, &action);
+        }
+    }
+    return applied;
+}
+
+// --- Função Desfazer ---
+void undoLastAction(TaskList *taskList, History *history) {
+    if (history->undo.count == 0) {
+        report("Nada para desfazer.\n");
+        return;
+    }
+    notify("Desfazendo a última ação...\n");
+    replayHistory(taskList, history, true, 1, true);
+}
+
+// --- Função Refazer ---
+void redoLastAction(TaskList *taskList, History *history) {
+    if (history->redo.count == 0) {
+        report("Nada para refazer.\n");
+        return;
+    }
+    notify("Refazendo a última ação desfeita...\n");
+    replayHistory(taskList, history, false, 1, true);
+}
+
+// Desfaz (undo=true) ou refaz até 'count' ações de uma vez, com um único resumo
+void replayActions(TaskList *taskList, History *history, bool undo, size_t count) {
+    size_t applied = replayHistory(taskList, history, undo, count, false);
+    if (applied == 0) {
+        report(undo ? "Nada para desfazer.\n" : "Nada para refazer.\n");
+    } else {
+        notify("%zu ação(ões) %s.\n", applied, undo ? "desfeita(s)" : "refeita(s)");
+    }
+}
+
+// --- Comandos (compartilhados pelo menu e pelo modo em lote) ---
+
+// Contexto de execução dos comandos: a lista e o histórico de quem os emite
+typedef struct {
+    TaskList *list;
+    History *history;
+} Session;
+
+// Adiciona uma tarefa e registra a ação para desfazer
+void addTaskCommand(Session *session, const char *description) {
+    int id = addTask(session->list, description);
+    // Empilha a ação de ADICIONAR para desfazer
+    recordAction(session->history, ACTION_ADD, id, false);
+}
+
+// Conclui uma tarefa e registra a ação para desfazer
+void completeTaskCommand(Session *session, int id) {
+    Task *taskToComplete = findTask(session->list, id);
+    bool was_completed_before = false;
+    if (taskToComplete != NULL) {
+        was_completed_before = taskToComplete->completed;
+    }
+    if (completeTask(session->list, id)) {
+        // Empilha a ação de CONCLUIR para desfazer
+        recordAction(session->history, ACTION_COMPLETE, id, was_completed_before);
+    }
+}
+
+// Conclui as tarefas pendentes de um conjunto de IDs com uma única ação para desfazer
+// Consome o bitset de 'set'
+void completeSetCommand(Session *session, IdSet *set) {
+    if (completeTaskSet(session->list, set) > 0) {
+        recordSet(session->history, ACTION_COMPLETE_SET, set, NULL);
+    }
+    destroyIdSet(set);
+}
+
+// Remove as tarefas de um conjunto de IDs com uma única ação para desfazer
+// Consome o bitset de 'set'
+void removeSetCommand(Session *session, IdSet *set) {
+    Task *removed;
+    if (removeTaskSet(session->list, set, &removed) > 0) {
+        recordSet(session->history, ACTION_REMOVE_SET, set, removed);
+    }
+    destroyIdSet(set);
+}
+
+// Remove uma tarefa e registra a ação para desfazer
+void removeTaskCommand(Session *session, int id) {
+    Task *removed = removeTask(session->list, id);
+    if (removed != NULL) {
+        // Empilha a ação de REMOVER para desfazer, transferindo o nó para o histórico
+        recordRemove(session->history, removed);
+    }
+}
+
+// Muda a prioridade e o prazo de uma tarefa e registra a ação para desfazer
+void scheduleTaskCommand(Session *session, int id, int priority, int32_t due) {
+    Task *task = findTask(session->list, id);
+    if (task == NULL) {
+        report("Tarefa com ID %d não encontrada.\n", id);
+        return;
+    }
+    int old_priority = task->priority;
+    int32_t old_due = task->due;
+    setTaskSchedule(session->list, task, priority, due);
+    char text[DUE_TEXT_SIZE];
+    formatDueDate(due, text);
+    notify("Tarefa %d com prioridade %d e prazo %s.\n", id, priority, text);
+    recordSchedule(session->history, id, old_priority, old_due);
+}
+
+// Importa uma tarefa por linha do arquivo 'path', registrando uma única ação para desfazer
+// Retorna false se o arquivo não puder ser lido
+bool importTasksCommand(Session *session, const char *path) {
+    size_t size;
+    unsigned char *data = readWholeFile(path, &size);
+    if (data == NULL) {
+        perror(path);
+        return false;
+    }
+    int first_id;
+    size_t count = addTasksFromBuffer(session->list, (const char *)data, size, &first_id);
+    free(data);
+    if (count == 0) {
+        report("Nenhuma tarefa encontrada em '%s'.\n", path);
+        return true;
+    }
+    recordImport(session->history, first_id, (int)count);
+    return true;
+}
+
+// --- Modo em Lote (comandos por linha, sem menu) ---
+
+// Leitor de linhas com buffer próprio sobre um descritor de arquivo
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t capacity;
+    size_t start; // Início da próxima linha no buffer
+    size_t end;   // Fim dos dados lidos
+    bool eof;
+    int error;    // errno da leitura que falhou (0 = nenhuma)
+} LineReader;
+
+// Inicializa o leitor sobre 'fd'
+void initLineReader(LineReader *reader, int fd) {
+    reader->fd = fd;
+    reader->capacity = 64 * 1024;
+    reader->buffer = (char *)malloc(reader->capacity + 1);
+    if (!reader->buffer) {
+        perror("Erro ao alocar memória para leitura de comandos");
+        exit(EXIT_FAILURE);
+    }
+    reader->start = 0;
+    reader->end = 0;
+    reader->eof = false;
+    reader->error = 0;
+}
+
+// Retorna a próxima linha (sem o '\n' ou '\r\n'), válida até a próxima chamada
+// Retorna NULL no fim da entrada; se a leitura falhar, 'error' fica com o
+// motivo e a entrada termina ali
+char *readLine(LineReader *reader, size_t *length) {
+    for (;;) {
+        char *line = reader->buffer + reader->start;
+        char *newline = (char *)memchr(line, '\n', reader->end - reader->start);
+        if (newline != NULL || (reader->eof && reader->start < reader->end)) {
+            size_t len = newline ? (size_t)(newline - line) : reader->end - reader->start;
+            reader->start += newline ? len + 1 : len;
+            if (len > 0 && line[len - 1] == '\r') {
+                len--;
+            }
+            line[len] = '\0';
+            *length = len;
+            return line;
+        }
+        if (reader->eof) {
+            return NULL;
+        }
+        // Move a linha incompleta para o início e, se ela ocupa o buffer todo, cresce
+        memmove(reader->buffer, line, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        if (reader->end == reader->capacity) {
+            reader->capacity *= 2;
+            reader->buffer = (char *)realloc(reader->buffer, reader->capacity + 1);
+            if (!reader->buffer) {
+                perror("Erro ao alocar memória para leitura de comandos");
+                exit(EXIT_FAILURE);
+            }
+        }
+        ssize_t n = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != ECONNRESET) {
+                reader->error = errno; // ECONNRESET: cliente do servidor saiu sem fechar a conexão
+            }
+            reader->eof = true;
+            continue;
+        }
+        if (n == 0) {
+            reader->eof = true;
+        }
+        reader->end += (size_t)n;
+    }
+}
+
+// Libera o buffer do leitor
+void destroyLineReader(LineReader *reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+// Lê um número inteiro de 'text'; avança 'text' para depois dele
+bool parseIntArg(const char **text, long long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoll(*text, &end, 10);
+    if (end == *text || errno != 0) {
+        return false;
+    }
+    *text = end;
+    return true;
+}
+
+// Lê um ID de tarefa como único argumento do comando
+bool parseIdArg(const char *args, int *id) {
+    long long value;
+    if (!parseIntArg(&args, &value) || value < INT32_MIN || value > INT32_MAX) {
+        return false;
+    }
+    while (*args == ' ' || *args == '\t') {
+        args++;
+    }
+    *id = (int)value;
+    return *args == '\0';
+}
+
+// Lê um intervalo de IDs no formato A-B (ou A-, até o maior ID)
+bool parseIdRange(const char *text, int *first, int *last) {
+    long long low, high = INT_MAX;
+    if (!parseIntArg(&text, &low) || *text++ != '-' || low < 0 || low > INT_MAX) {
+        return false;
+    }
+    if (*text != '\0' && (!parseIntArg(&text, &high) || high < low || high > INT_MAX)) {
+        return false;
+    }
+    *first = (int)low;
+    *last = (int)high;
+    return *text == '\0';
+}
+
+// Lê um prazo no formato AAAA-MM-DD (a partir de 1970-01-02), ou "-" para nenhum
+bool parseDueDate(const char *text, int32_t *due) {
+    if (strcmp(text, "-") == 0) {
+        *due = 0;
+        return true;
+    }
+    static const int month_days[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int year, month, day, length;
+    if (sscanf(text, "%4d-%2d-%2d%n", &year, &month, &day, &length) != 3 || text[length] != '\0' ||
+        month < 1 || month > 12 || day < 1 || day > month_days[month - 1]) {
+        return false;
+    }
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month == 2 && day == 29 && !leap) {
+        return false;
+    }
+    *due = daysFromCivil(year, month, day);
+    return *due > 0;
+}
+
+// Lê um conjunto de IDs: itens separados por vírgulas ou espaços, cada um
+// um ID (N) ou um intervalo (A-B, ou A- até o maior ID); por exemplo "1,5,10-20"
+// IDs acima de 'max_id' não existem e são descartados
+// Retorna false se o texto for inválido; 'set' só é preenchido se for válido
+bool parseIdSet(const char *text, IdSet *set, int max_id) {
+    int first = INT_MAX, last = -1;
+    for (int pass = 0; pass < 2; pass++) {
+        const char *p = text;
+        for (;;) {
+            p += strspn(p, ", \t");
+            if (*p == '\0') {
+                break;
+            }
+            long long low, high;
+            if (!parseIntArg(&p, &low) || low < 0 || low > INT_MAX) {
+                return false;
+            }
+            high = low;
+            if (*p == '-') {
+                p++;
+                high = max_id;
+                if (*p != '\0' && *p != ',' && *p != ' ' && *p != '\t' &&
+                    (!parseIntArg(&p, &high) || high < low || high > INT_MAX)) {
+                    return false;
+                }
+            }
+            if (*p != '\0' && *p != ',' && *p != ' ' && *p != '\t') {
+                return false;
+            }
+            if (high > max_id) {
+                high = max_id;
+            }
+            if (low > high) {
+                continue; // Nenhum ID existente no item
+            }
+            if (pass == 0) {
+                first = (int)low < first ? (int)low : first;
+                last = (int)high > last ? (int)high : last;
+            } else {
+                idSetAddRange(set, (int)low, (int)high);
+            }
+        }
+        if (pass == 0) {
+            if (last < 0) {
+                set->first = 1; // Conjunto vazio
+                set->last = 0;
+                set->bits = NULL;
+                return true;
+            }
+            initIdSet(set, first, last);
+        }
+    }
+    return true;
+}
+
+// Lê os critérios de uma listagem a partir de 'args', em qualquer ordem:
+// um estado (all, pending ou done), "sorted" para ordem de ID, um intervalo de IDs (A-B ou A-) e até
+// dois números, o limite e o deslocamento da página
+// 'args' é modificado
+bool parseListFilter(char *args, TaskFilter *filter) {
+    initTaskFilter(filter);
+    int numbers = 0;
+    char *saveptr;
+    for (char *token = strtok_r(args, " \t", &saveptr); token != NULL; token = strtok_r(NULL, " \t", &saveptr)) {
+        const char *p = token;
+        long long low;
+        if (strcmp(token, "all") == 0) {
+            filter->state = FILTER_ALL;
+        } else if (strcmp(token, "pending") == 0) {
+            filter->state = FILTER_PENDING;
+        } else if (strcmp(token, "done") == 0) {
+            filter->state = FILTER_COMPLETED;
+        } else if (strcmp(token, "sorted") == 0) {
+            filter->sorted = true;
+        } else if (strchr(token, '-') != NULL) {
+            if (!parseIdRange(token, &filter->min_id, &filter->max_id)) {
+                return false;
+            }
+        } else {
+            if (!parseIntArg(&p, &low) || *p != '\0' || low < 0 || numbers == 2) {
+                return false;
+            }
+            if (numbers++ == 0) {
+                filter->limit = (size_t)low;
+            } else {
+                filter->offset = (size_t)low;
+            }
+        }
+    }
+    return true;
+}
+
+// Escreve o dump dos contadores em stderr a cada tantos comandos (0 = nunca)
+size_t stats_every = 0;
+static _Atomic size_t commands_since_dump = 0;
+
+// Executa uma linha de comando do modo em lote
+// Comandos: add <descrição>, done <ids>, rm <ids>, import <arquivo>,
+// undo [n], redo [n], list [filtro], search <palavras>, find <trecho>, stats [A-B], sync,
+// prio <id> <0-9>, due <id> <AAAA-MM-DD|->, next [n]
+// Linhas vazias e iniciadas por '#' são ignoradas. Retorna false se a linha for inválida
+bool executeCommand(Session *session, char *line) {
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (*line == '\0' || *line == '#') {
+        return true;
+    }
+    COUNT(COUNTER_COMMANDS, 1);
+    if (stats_every != 0 && atomic_fetch_add_explicit(&commands_since_dump, 1, memory_order_relaxed) % stats_every == stats_every - 1) {
+        dumpCounters(stderr, session->history);
+    }
+    char *args = line + strcspn(line, " \t");
+    if (*args != '\0') {
+        *args++ = '\0';
+        while (*args == ' ' || *args == '\t') {
+            args++;
+        }
+    }
+
+    int id;
+    if (strcmp(line, "add") == 0) {
+        if (*args == '\0') {
+            return false;
+        }
+        addTaskCommand(session, args);
+    } else if (strcmp(line, "done") == 0 || strcmp(line, "rm") == 0) {
+        bool done = line[0] == 'd';
+        IdSet set;
+        if (parseIdArg(args, &id)) {
+            if (done) {
+                completeTaskCommand(session, id);
+            } else {
+                removeTaskCommand(session, id);
+            }
+        } else if (*args != '\0' && parseIdSet(args, &set, session->list->next_id - 1)) {
+            if (done) {
+                completeSetCommand(session, &set);
+            } else {
+                removeSetCommand(session, &set);
+            }
+        } else {
+            return false;
+        }
+    } else if (strcmp(line, "prio") == 0 || strcmp(line, "due") == 0) {
+        char *value = args + strcspn(args, " \t");
+        if (*value != '\0') {
+            *value++ = '\0';
+            value += strspn(value, " \t");
+        }
+        long long level = 0;
+        int32_t due = 0;
+        const char *p = value;
+        if (!parseIdArg(args, &id) ||
+            (line[0] == 'p' ? !parseIntArg(&p, &level) || *p != '\0' || level < 0 || level > MAX_PRIORITY
+                            : !parseDueDate(value, &due))) {
+            return false;
+        }
+        const Task *task = findTask(session->list, id);
+        if (task == NULL) {
+            report("Tarefa com ID %d não encontrada.\n", id);
+        } else if (line[0] == 'p') {
+            scheduleTaskCommand(session, id, (int)level, task->due);
+        } else {
+            scheduleTaskCommand(session, id, task->priority, due);
+        }
+    } else if (strcmp(line, "next") == 0) {
+        id = 1;
+        if (*args != '\0' && (!parseIdArg(args, &id) || id < 1)) {
+            return false;
+        }
+        nextTasks(session->list, (size_t)id);
+    } else if (strcmp(line, "sync") == 0) {
+        if (*args != '\0') {
+            return false;
+        }
+        journalSync(session->history->store);
+        notify("Diário gravado no disco.\n");
+    } else if (strcmp(line, "stats") == 0) {
+        int first = 0, last = INT_MAX;
+        if (*args != '\0' && !parseIdRange(args, &first, &last)) {
+            return false;
+        }
+        printStats(session->list, first, last);
+        printCounters(session->history);
+    } else if (strcmp(line, "undo") == 0 || strcmp(line, "redo") == 0) {
+        bool undo = line[0] == 'u';
+        if (*args == '\0') {
+            if (undo) {
+                undoLastAction(session->list, session->history);
+            } else {
+                redoLastAction(session->list, session->history);
+            }
+        } else {
+            if (!parseIdArg(args, &id) || id < 0) {
+                return false;
+            }
+            replayActions(session->list, session->history, undo, (size_t)id);
+        }
+    } else if (strcmp(line, "import") == 0) {
+        if (*args == '\0') {
+            return false;
+        }
+        importTasksCommand(session, args);
+    } else if (strcmp(line, "search") == 0) {
+        if (*args == '\0') {
+            return false;
+        }
+        searchTasks(session->list, args);
+    } else if (strcmp(line, "find") == 0) {
+        if (*args == '\0') {
+            return false;
+        }
+        findTasks(session->list, args);
+    } else if (strcmp(line, "list") == 0) {
+        if (*args == '\0') {
+            listTasks(session->list);
+        } else {
+            TaskFilter filter;
+            if (!parseListFilter(args, &filter)) {
+                return false;
+            }
+            listTasksFiltered(session->list, &filter);
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Executa todos os comandos lidos de 'fd', sem menu
+// Retorna o número de linhas inválidas (relatadas em stderr)
+size_t runBatch(Session *session, int fd) {
+    LineReader reader;
+    initLineReader(&reader, fd);
+    size_t errors = 0;
+    size_t line_number = 0;
+    size_t length;
+    char *line;
+    while ((line = readLine(&reader, &length)) != NULL) {
+        line_number++;
+        if (!executeCommand(session, line)) {
+            fprintf(stderr, "Linha %zu: comando inválido\n", line_number);
+            errors++;
+        }
+    }
+    if (reader.error != 0) {
+        errno = reader.error;
+        perror("Erro ao ler comandos");
+        exit(EXIT_FAILURE);
+    }
+    destroyLineReader(&reader);
+    return errors;
+}
+
+// --- Modo Servidor (vários clientes por um socket Unix) ---
+
+// Máximo de pedidos aplicados de uma vez pela thread que altera a lista
+#define SERVER_BATCH_MAX 64
+
+// Pedido de alteração enviado por um cliente à thread que altera a lista
+// Fica na pilha do cliente, que espera 'done' antes de reaproveitá-lo
+typedef struct ServerRequest {
+    _Atomic(struct ServerRequest *) next; // Próximo pedido na fila
+    Session *session; // Lista e histórico do cliente (NULL = pedido de parada)
+    FILE *output;     // Saída do cliente
+    char *line;       // Linha de comando
+    bool ok;          // Resultado de executeCommand
+    sem_t done;       // Sinalizado quando o pedido foi aplicado e gravado no diário
+} ServerRequest;
+
+// Fila sem travas de vários produtores e um consumidor (algoritmo de Vyukov):
+// os produtores só fazem uma troca atômica em 'head', e só o consumidor mexe em 'tail'
+typedef struct {
+    _Atomic(ServerRequest *) head; // Último pedido enfileirado
+    ServerRequest *tail;           // Próximo pedido a consumir (ou 'stub')
+    ServerRequest stub;            // Nó vazio que mantém a fila sempre com um elemento
+    sem_t pending;                 // Conta os pedidos enfileirados
+} RequestQueue;
+
+// Estado compartilhado pelas threads do servidor
+// Todos os clientes operam sobre a mesma lista; cada um tem o próprio histórico
+typedef struct {
+    TaskList *list;
+    TaskStore *store;      // Persistência compartilhada (NULL = desligada)
+    size_t undo_depth;     // Profundidade do histórico de cada cliente
+    pthread_rwlock_t lock; // Consultas rodam em paralelo; os lotes de alterações, sozinhos
+    RequestQueue queue;    // Alterações à espera da thread que as aplica
+    pthread_t mutator;     // Thread única que altera a lista
+    struct ServerClient *clients; // Conexões ainda não recolhidas (só a thread principal mexe)
+} Server;
+
+// Conexão de um cliente, entregue à thread que a atende
+// O socket só é fechado pela thread principal, depois de recolher a thread,
+// para que o encerramento nunca chame shutdown num descritor já reaproveitado
+typedef struct ServerClient {
+    Server *server;
+    int fd;
+    pthread_t thread;
+    _Atomic bool finished;     // A thread do cliente terminou e pode ser recolhida
+    struct ServerClient *next; // Próxima conexão em Server::clients
+} ServerClient;
+
+// Pedido de encerramento (SIGINT/SIGTERM) recebido pelo servidor
+static volatile sig_atomic_t server_stopping = 0;
+
+void stopServer(int signal_number) {
+    (void)signal_number;
+    server_stopping = 1;
 }
 
-// Adiciona uma tarefa ao final da lista
-void addTask(TaskList *list, const char *description) {
-    Task *newTask = createTask(list->next_id++, description);
-    if (list->head == NULL) {
-        list->head = newTask;
-        list->tail = newTask;
-    } else {
-        list->tail->next = newTask;
-        list->tail = newTask;
-    }
-    printf("Tarefa '%s' (ID: %d) adicionada com sucesso.\n", description, newTask->id);
+// Bloqueia SIGINT/SIGTERM na thread atual e nas que ela criar depois,
+// guardando a máscara anterior em 'previous' (se não for NULL)
+// O servidor só atende esses sinais no ppoll da espera por conexões: se
+// outra thread pudesse recebê-los, o pedido de parada não acordaria a espera
+void blockStopSignals(sigset_t *previous) {
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, previous);
 }
 
-// Lista todas as tarefas na lista
-void listTasks(const TaskList *list) {
-    if (list->head == NULL) {
-        printf("Nenhuma tarefa na lista.\n");
-        return;
+// Diz se a linha é o comando 'name'
+bool isCommand(const char *line, const char *name) {
+    line += strspn(line, " \t");
+    size_t length = strcspn(line, " \t");
+    return length == strlen(name) && memcmp(line, name, length) == 0;
+}
+
+// Diz se a linha só consulta a lista e pode rodar junto de outras consultas
+// search e find só são consultas quando o índice e o pacote já estão montados;
+// do contrário, a primeira chamada os monta e precisa da lista só para si
+bool isReadOnlyCommand(const TaskList *list, const char *line) {
+    if (isCommand(line, "list") || isCommand(line, "stats") || isCommand(line, "next")) {
+        return true;
+    }
+    if (isCommand(line, "search")) {
+        return list->search.built;
     }
-    printf("\n--- Lista de Tarefas ---\n");
-    Task *current = list->head;
-    while (current != NULL) {
-        printf("ID: %d | Estado: [%s] | Descrição: %s\n",
-               current->id,
-               current->completed ? "X" : " ", // 'X' para concluída, ' ' para pendente
-               current->description);
-        current = current->next;
+    if (isCommand(line, "find")) {
+        return list->pack.valid;
     }
-    printf("------------------------\n");
+    return false;
 }
 
-// Marca uma tarefa como concluída
-bool completeTask(TaskList *list, int id) {
-    Task *current = list->head;
-    while (current != NULL) {
-        if (current->id == id) {
-            if (current->completed) {
-                printf("Tarefa %d já está concluída.\n", id);
-                return false;
+// Inicializa a fila vazia (só com o nó 'stub')
+void initRequestQueue(RequestQueue *queue) {
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
+    sem_init(&queue->pending, 0, 0);
+}
+
+// Encadeia 'request' no fim da fila, sem contar como pedido
+void requestQueueLink(RequestQueue *queue, ServerRequest *request) {
+    atomic_store_explicit(&request->next, NULL, memory_order_relaxed);
+    ServerRequest *previous = atomic_exchange_explicit(&queue->head, request, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, request, memory_order_release);
+}
+
+// Enfileira um pedido (de qualquer thread)
+void requestQueuePush(RequestQueue *queue, ServerRequest *request) {
+    requestQueueLink(queue, request);
+    sem_post(&queue->pending);
+}
+
+// Retira o pedido mais antigo (só a thread consumidora chama)
+// Só deve ser chamada depois de 'pending' confirmar que há um pedido; se um
+// produtor estiver no meio do encadeamento, espera ele terminar
+ServerRequest *requestQueuePop(RequestQueue *queue) {
+    for (;;) {
+        ServerRequest *tail = queue->tail;
+        ServerRequest *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        if (tail == &queue->stub) {
+            if (next == NULL) {
+                sched_yield(); // O pedido contado ainda não foi encadeado
+                continue;
             }
-            current->completed = true;
-            printf("Tarefa %d marcada como concluída.\n", id);
-            return true;
+            queue->tail = next;
+            tail = next;
+            next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        }
+        if (next != NULL) {
+            queue->tail = next;
+            return tail;
+        }
+        if (tail != atomic_load_explicit(&queue->head, memory_order_acquire)) {
+            sched_yield(); // Outro pedido está sendo encadeado depois deste
+            continue;
         }
-        current = current->next;
+        // 'tail' é o último: o stub volta para o fim para que ele possa sair
+        requestQueueLink(queue, &queue->stub);
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        if (next != NULL) {
+            queue->tail = next;
+            return tail;
+        }
+        sched_yield();
     }
-    printf("Tarefa com ID %d não encontrada.\n", id);
-    return false;
 }
 
-// Remove uma tarefa da lista
-// Retorna a tarefa removida (para fins de "desfazer") ou NULL se não encontrada
-Task *removeTask(TaskList *list, int id) {
-    Task *current = list->head;
-    Task *previous = NULL;
-
-    while (current != NULL && current->id != id) {
-        previous = current;
-        current = current->next;
+// Thread que altera a lista: aplica os pedidos em lotes de até SERVER_BATCH_MAX
+// Cada lote segura a trava de escrita uma vez e é entregue ao diário de uma
+// vez só (com --sync-window 0, numa única sincronização); os clientes só
+// recebem a resposta depois disso
+void *runMutator(void *arg) {
+    Server *server = (Server *)arg;
+    ServerRequest *batch[SERVER_BATCH_MAX];
+    bool stopping = false;
+    while (!stopping) {
+        while (sem_wait(&server->queue.pending) != 0) {
+        }
+        size_t count = 0;
+        pthread_rwlock_wrlock(&server->lock);
+        journalBeginBatch(server->store);
+        do {
+            ServerRequest *request = requestQueuePop(&server->queue);
+            batch[count++] = request;
+            if (request->session == NULL) {
+                stopping = true;
+                break;
+            }
+            thread_output = request->output;
+            request->ok = executeCommand(request->session, request->line);
+        } while (count < SERVER_BATCH_MAX && sem_trywait(&server->queue.pending) == 0);
+        thread_output = NULL;
+        journalEndBatch(server->store);
+        if (hasRetiredText(&server->list->strings)) {
+            // Leitores que já saíram não seguram mais o que foi aposentado
+            reclaimRetiredText(&server->list->strings, &server->list->text);
+        }
+        pthread_rwlock_unlock(&server->lock);
+        for (size_t i = 0; i < count; i++) {
+            sem_post(&batch[i]->done);
+        }
     }
+    return NULL;
+}
 
-    if (current == NULL) {
-        printf("Tarefa com ID %d não encontrada.\n", id);
-        return NULL; // Tarefa não encontrada
+// Executa uma linha de comando de um cliente
+// Consultas rodam aqui mesmo: a listagem é montada na memória com a trava de
+// leitura, uma visão consistente da lista, e só é enviada depois de soltá-la,
+// para que um cliente lento não segure quem altera a lista. As descrições
+// longas enviadas sem cópia ficam protegidas pela época do leitor
+// Alterações vão para a thread que altera a lista, e o cliente espera a resposta
+// A classificação é feita já com a trava de leitura, para que nenhuma
+// alteração invalide o índice ou o pacote entre a decisão e a execução
+bool executeSharedCommand(Server *server, ServerRequest *request, ReaderSlot *reader, char *line) {
+    if (isCommand(line, "sync")) {
+        // Só espera o diário, sem tocar na lista; o armazenamento continua
+        // aberto até runServer recolher esta thread
+        return executeCommand(request->session, line);
     }
-
-    // Remover a tarefa se:
-    if (previous == NULL) { // Se for o primeiro nó
-        list->head = current->next;
-    } else {
-        previous->next = current->next;
+    fflush(request->output); // A resposta capturada vai direto ao socket, depois do que já saiu
+    pthread_rwlock_rdlock(&server->lock);
+    if (isReadOnlyCommand(server->list, line)) {
+        OutputCapture capture;
+        initOutputCapture(&capture);
+        readerEnter(&server->list->strings, reader);
+        thread_capture = &capture;
+        bool ok = executeCommand(request->session, line);
+        thread_capture = NULL;
+        pthread_rwlock_unlock(&server->lock);
+        sendOutputCapture(&capture, fileno(request->output));
+        readerExit(reader);
+        if (hasRetiredText(&server->list->strings)) {
+            // Sem isso, o que esperava por esta leitura só voltaria à arena
+            // quando outro texto morresse, o que pode não acontecer num
+            // servidor só de consultas; a arena pede a trava de escrita
+            pthread_rwlock_wrlock(&server->lock);
+            reclaimRetiredText(&server->list->strings, &server->list->text);
+            pthread_rwlock_unlock(&server->lock);
+        }
+        return ok;
     }
-
-    if (current == list->tail) { // Se for o último nó
-        list->tail = previous;
+    pthread_rwlock_unlock(&server->lock);
+    request->line = line;
+    requestQueuePush(&server->queue, request);
+    while (sem_wait(&request->done) != 0) {
     }
-
-    printf("Tarefa %d ('%s') removida com sucesso.\n", current->id, current->description);
-    return current; // Retorna o nó (ainda com memória alocada para ele e sua descrição)
+    return request->ok;
 }
 
-// Libera toda a memória da lista de tarefas
-void destroyTaskList(TaskList *list) {
-    Task *current = list->head;
-    while (current != NULL) {
-        Task *next = current->next;
-        free(current->description); // Libera a descrição
-        free(current);             // Libera o nó da tarefa
-        current = next;
+// Atende um cliente até ele fechar a conexão, com os mesmos comandos do modo em lote
+// As mensagens e listagens vão para o socket do cliente
+void *serveClient(void *arg) {
+    ServerClient *client = (ServerClient *)arg;
+    Server *server = client->server;
+    int out_fd = dup(client->fd);
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (out == NULL) {
+        perror("Erro ao abrir a saída do cliente");
+        if (out_fd >= 0) {
+            close(out_fd);
+        }
+        atomic_store_explicit(&client->finished, true, memory_order_release);
+        return NULL;
     }
-    list->head = NULL;
-    list->tail = NULL;
-    list->next_id = 1;
-    printf("Toda a memória da lista de tarefas foi liberada.\n");
-}
+    thread_output = out;
 
-// --- Funções da Pilha de Ações (Histórico - para Desfazer) ---
+    History history;
+    initHistory(&history, server->list, server->undo_depth, server->store);
+    Session session = { server->list, &history };
+    ServerRequest request;
+    request.session = &session;
+    request.output = out;
+    sem_init(&request.done, 0, 0);
+    ReaderSlot slot;
+    registerReader(&server->list->strings, &slot);
+    LineReader reader;
+    initLineReader(&reader, client->fd);
+    size_t length;
+    char *line;
+    while ((line = readLine(&reader, &length)) != NULL) {
+        if (!executeSharedCommand(server, &request, &slot, line)) {
+            report("Comando inválido\n");
+        }
+        if (fflush(out) != 0) {
+            break; // Cliente foi embora
+        }
+    }
+    if (reader.error != 0) {
+        fprintf(stderr, "Erro ao ler comandos de um cliente: %s\n", strerror(reader.error));
+    }
 
-// Inicializa a pilha de ações
-void initActionStack(ActionStack *stack) {
-    stack->top = NULL;
+    unregisterReader(&server->list->strings, &slot);
+    // Os nós guardados no histórico voltam aos alocadores da lista compartilhada
+    pthread_rwlock_wrlock(&server->lock);
+    clearActionStack(&history.undo);
+    clearActionStack(&history.redo);
+    pthread_rwlock_unlock(&server->lock);
+    destroyActionStack(&history.undo);
+    destroyActionStack(&history.redo);
+    sem_destroy(&request.done);
+    destroyLineReader(&reader);
+    thread_output = NULL;
+    fclose(out);
+    shutdown(client->fd, SHUT_RDWR); // O cliente vê o fim da conexão já; o descritor fecha ao recolher
+    atomic_store_explicit(&client->finished, true, memory_order_release);
+    return NULL;
 }
 
-// Empilha uma ação
-void pushAction(ActionStack *stack, ActionType type, int task_id, const char *task_description, bool was_completed) {
-    Action *newAction = (Action *)malloc(sizeof(Action));
-    if (!newAction) {
-        perror("Erro ao alocar memória para a ação na pilha");
-        exit(EXIT_FAILURE);
-    }
-    newAction->type = type;
-    newAction->task_id = task_id;
-    newAction->task_description = NULL; // Inicializa como NULL
-    if (task_description) {
-        newAction->task_description = strdup(task_description);
-        if (!newAction->task_description) {
-            perror("Erro ao alocar memória para descrição da ação");
-            free(newAction);
-            exit(EXIT_FAILURE);
+// Recolhe as threads de clientes já terminadas (todas, com 'all', depois de
+// derrubar as conexões), fechando os sockets delas
+void reapServerClients(Server *server, bool all) {
+    ServerClient **link = &server->clients;
+    while (*link != NULL) {
+        ServerClient *client = *link;
+        if (!all && !atomic_load_explicit(&client->finished, memory_order_acquire)) {
+            link = &client->next;
+            continue;
         }
+        pthread_join(client->thread, NULL);
+        close(client->fd);
+        *link = client->next;
+        free(client);
     }
-    newAction->was_completed = was_completed;
-    newAction->next = stack->top;
-    stack->top = newAction;
 }
 
-// Desempilha uma ação
-Action *popAction(ActionStack *stack) {
-    if (stack->top == NULL) {
-        return NULL; // Pilha vazia
+// Abre o socket Unix 'path' para receber conexões
+// Um socket antigo no mesmo caminho é substituído; qualquer outro arquivo, não
+// Retorna o descritor, ou -1 em erro
+int openServerSocket(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Caminho de socket longo demais: %s\n", path);
+        return -1;
     }
-    Action *action = stack->top;
-    stack->top = stack->top->next;
-    return action;
+    strcpy(address.sun_path, path);
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-// Libera toda a memória da pilha de ações
-void destroyActionStack(ActionStack *stack) {
-    Action *current = stack->top;
-    while (current != NULL) {
-        Action *next = current->next;
-        free(current->task_description); // Libera a descrição, se houver
-        free(current);                   // Libera o nó da ação
-        current = next;
+// Serve 'session->list' em 'path' até receber SIGINT ou SIGTERM
+// Cada conexão ganha uma thread e um histórico próprio, com a mesma
+// profundidade e persistência do histórico de 'session'; todas as alterações
+// passam pela fila e são aplicadas por uma única thread
+// Só retorna depois que todas as threads do servidor terminaram, então a
+// lista e o armazenamento podem ser fechados em seguida
+// Retorna false se o socket não puder ser aberto
+bool runServer(Session *session, const char *path) {
+    Server *server = (Server *)malloc(sizeof(Server));
+    if (!server) {
+        perror("Erro ao alocar memória para o servidor");
+        exit(EXIT_FAILURE);
     }
-    stack->top = NULL;
-    printf("Toda a memória do histórico de ações foi liberada.\n");
-}
+    server->list = session->list;
+    server->store = session->history->store;
+    server->undo_depth = session->history->undo.max_depth;
+    server->clients = NULL;
+    // Preferência para quem escreve: uma fila de consultas não adia alterações indefinidamente
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&server->lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
 
-// --- Função Desfazer ---
-void undoLastAction(TaskList *taskList, ActionStack *actionStack) {
-    Action *lastAction = popAction(actionStack);
-    if (!lastAction) {
-        printf("Nada para desfazer.\n");
-        return;
+    int listen_fd = openServerSocket(path);
+    if (listen_fd < 0) {
+        pthread_rwlock_destroy(&server->lock);
+        free(server);
+        return false;
     }
 
-    printf("Desfazendo a última ação...\n");
+    // Os sinais de encerramento ficam bloqueados nas demais threads (main já
+    // os bloqueou antes de iniciar a thread escritora do diário) e só são
+    // atendidos aqui, durante a espera por conexões
+    sigset_t wait_mask;
+    blockStopSignals(&wait_mask);
+    sigdelset(&wait_mask, SIGINT);
+    sigdelset(&wait_mask, SIGTERM);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN); // Escrever para um cliente que saiu só falha a escrita
 
-    switch (lastAction->type) {
-        case ACTION_ADD: {
-            // Se a última ação foi ADICIONAR, remove a tarefa que foi adicionada.
-            // Encontrar a tarefa na lista e removê-la.
-            Task *current = taskList->head;
-            Task *previous = NULL;
-            while (current != NULL && current->id != lastAction->task_id) {
-                previous = current;
-                current = current->next;
-            }
-            if (current != NULL) {
-                if (previous == NULL) {
-                    taskList->head = current->next;
-                } else {
-                    previous->next = current->next;
-                }
-                if (current == taskList->tail) {
-                    taskList->tail = previous;
-                }
-                free(current->description);
-                free(current);
-                printf("Desfeito: Tarefa (ID: %d) removida (originalmente adicionada).\n", lastAction->task_id);
-            } else {
-                printf("Erro ao desfazer: Tarefa adicionada (ID: %d) não encontrada para remoção.\n", lastAction->task_id);
-            }
-            break;
+    initRequestQueue(&server->queue);
+    if (pthread_create(&server->mutator, NULL, runMutator, server) != 0) {
+        fprintf(stderr, "Não foi possível iniciar a thread do servidor\n");
+        exit(EXIT_FAILURE);
+    }
+
+    notify("Servindo em %s\n", path);
+    fflush(stdout);
+    while (!server_stopping) {
+        struct pollfd waiting = { listen_fd, POLLIN, 0 };
+        if (ppoll(&waiting, 1, NULL, &wait_mask) <= 0) {
+            continue; // Sinal recebido (ou espera interrompida)
         }
-        case ACTION_COMPLETE: {
-            // Se a última ação foi CONCLUIR, reverte o estado de conclusão da tarefa.
-            Task *current = taskList->head;
-            while (current != NULL && current->id != lastAction->task_id) {
-                current = current->next;
-            }
-            if (current != NULL) {
-                current->completed = lastAction->was_completed;
-                printf("Desfeito: Tarefa (ID: %d) estado revertido para %s.\n", lastAction->task_id, lastAction->was_completed ? "concluída" : "pendente");
-            } else {
-                printf("Erro ao desfazer: Tarefa concluída (ID: %d) não encontrada para reverter.\n", lastAction->task_id);
-            }
-            break;
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
         }
-        case ACTION_REMOVE: {
-            // Se a última ação foi REMOVER, adiciona a tarefa de volta.
-            // O ID original da tarefa pode precisar ser ajustado se o next_id do TaskList
-            Task *readdedTask = createTask(lastAction->task_id, lastAction->task_description);
-            readdedTask->completed = lastAction->was_completed; // Reverte o estado original
-
-            // Adiciona a tarefa de volta na lista.
-            if (taskList->head == NULL) {
-                taskList->head = readdedTask;
-                taskList->tail = readdedTask;
-            } else {
-                taskList->tail->next = readdedTask;
-                taskList->tail = readdedTask;
-            }
-            // Assegura que o next_id não seja menor que um ID já usado
-            if (taskList->next_id <= lastAction->task_id) {
-                 taskList->next_id = lastAction->task_id + 1;
-            }
-            printf("Desfeito: Tarefa '%s' (ID: %d) adicionada novamente.\n", readdedTask->description, readdedTask->id);
-            break;
+        reapServerClients(server, false); // A cada conexão nova, recolhe as que já saíram
+        ServerClient *client = (ServerClient *)malloc(sizeof(ServerClient));
+        if (!client) {
+            perror("Erro ao alocar memória para o cliente");
+            exit(EXIT_FAILURE);
+        }
+        client->server = server;
+        client->fd = fd;
+        atomic_init(&client->finished, false);
+        if (pthread_create(&client->thread, NULL, serveClient, client) != 0) {
+            fprintf(stderr, "Não foi possível atender uma conexão\n");
+            close(fd);
+            free(client);
+            continue;
         }
+        client->next = server->clients;
+        server->clients = client;
     }
+    close(listen_fd);
+    unlink(path);
 
-    free(lastAction->task_description); // Libera a descrição da ação
-    free(lastAction);                   // Libera o nó da ação
-}
+    // Derruba as conexões: leituras pendentes veem o fim da entrada e escritas
+    // falham, e cada cliente termina o comando em andamento (a thread que
+    // altera a lista ainda atende) e solta o que pegou da lista
+    for (ServerClient *client = server->clients; client != NULL; client = client->next) {
+        shutdown(client->fd, SHUT_RDWR);
+    }
+    reapServerClients(server, true);
 
+    // Sem clientes, o pedido de parada é o último da fila
+    ServerRequest stop;
+    stop.session = NULL;
+    sem_init(&stop.done, 0, 0);
+    requestQueuePush(&server->queue, &stop);
+    pthread_join(server->mutator, NULL);
+    sem_destroy(&stop.done);
+    sem_destroy(&server->queue.pending);
+    pthread_rwlock_destroy(&server->lock);
+    free(server);
+    notify("Servidor encerrado.\n");
+    return true;
+}
 
-// --- Função Principal (main) ---
-int main() {
-    TaskList myTasks;
-    ActionStack undoStack;
+// --- Menu Interativo ---
 
-    initTaskList(&myTasks);
-    initActionStack(&undoStack);
+// Descarta o restante da linha digitada (para com segurança no fim da entrada)
+void discardLine(void) {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF) {
+    }
+}
 
+// Executa o menu interativo até o usuário escolher sair (ou a entrada acabar)
+void runInteractiveMenu(Session *session) {
     int choice;
     char description[256]; // Buffer para a descrição da tarefa
     int id_to_process;
+    int action_count; // Quantidade de ações para desfazer/refazer de uma vez
 
     do {
         printf("\n--- Gerenciador de Tarefas ---\n");
@@ -315,76 +5867,187 @@ int main() {
         printf("3. Marcar Tarefa como Concluída\n");
         printf("4. Remover Tarefa\n");
         printf("5. Desfazer Última Ação\n");
+        printf("6. Refazer Última Ação Desfeita\n");
+        printf("7. Desfazer Várias Ações\n");
+        printf("8. Refazer Várias Ações\n");
+        printf("9. Importar Tarefas de Arquivo\n");
+        printf("10. Listar Tarefas com Filtro\n");
+        printf("11. Buscar Tarefas por Palavras\n");
+        printf("12. Buscar Tarefas por Trecho do Texto\n");
+        printf("13. Estatísticas\n");
+        printf("14. Concluir Várias Tarefas\n");
+        printf("15. Remover Várias Tarefas\n");
+        printf("16. Definir Prioridade e Prazo\n");
+        printf("17. Próximas Tarefas\n");
         printf("0. Sair\n");
         printf("Escolha uma opção: ");
         
         // Garante que a entrada numérica seja lida corretamente e limpa o buffer do teclado
-        if (scanf("%d", &choice) != 1) {
+        int scanned = scanf("%d", &choice);
+        if (scanned == EOF) {
+            break; // Fim da entrada: sai como se o usuário tivesse escolhido 0
+        }
+        if (scanned != 1) {
             printf("Entrada inválida. Por favor, digite um número.\n");
-            while (getchar() != '\n'); // Limpa o buffer de entrada
+            discardLine(); // Limpa o buffer de entrada
             continue;
         }
-        while (getchar() != '\n'); // Limpa o buffer de entrada após a leitura do número
+        discardLine(); // Limpa o buffer de entrada após a leitura do número
 
         switch (choice) {
             case 1:
                 printf("Digite a descrição da tarefa: ");
                 if (fgets(description, sizeof(description), stdin) != NULL) {
                     description[strcspn(description, "\n")] = 0; // Remove o newline
-                    addTask(&myTasks, description);
-                    // Empilha a ação de ADICIONAR para desfazer
-                    pushAction(&undoStack, ACTION_ADD, myTasks.next_id -1, description, false);
+                    addTaskCommand(session, description);
                 } else {
                     printf("Erro ao ler a descrição.\n");
                 }
                 break;
             case 2:
-                listTasks(&myTasks);
+                listTasks(session->list);
                 break;
             case 3:
                 printf("Digite o ID da tarefa a ser concluída: ");
                 if (scanf("%d", &id_to_process) != 1) {
                     printf("Entrada inválida. Por favor, digite um número.\n");
-                    while (getchar() != '\n');
+                    discardLine();
                     break;
                 }
-                while (getchar() != '\n'); // Limpa o buffer
-
-                Task *taskToComplete = myTasks.head;
-                bool was_completed_before = false;
-                while(taskToComplete != NULL && taskToComplete->id != id_to_process) {
-                    taskToComplete = taskToComplete->next;
-                }
-                if (taskToComplete != NULL) {
-                    was_completed_before = taskToComplete->completed;
-                }
-                
-                if (completeTask(&myTasks, id_to_process)) {
-                    // Empilha a ação de CONCLUIR para desfazer
-                    pushAction(&undoStack, ACTION_COMPLETE, id_to_process, NULL, was_completed_before);
-                }
+                discardLine(); // Limpa o buffer
+                completeTaskCommand(session, id_to_process);
                 break;
             case 4:
                 printf("Digite o ID da tarefa a ser removida: ");
                 if (scanf("%d", &id_to_process) != 1) {
                     printf("Entrada inválida. Por favor, digite um número.\n");
-                    while (getchar() != '\n');
+                    discardLine();
                     break;
                 }
-                while (getchar() != '\n'); // Limpa o buffer
-
-                Task *removed = removeTask(&myTasks, id_to_process);
-                if (removed != NULL) {
-                    // Empilha a ação de REMOVER para desfazer
-                    pushAction(&undoStack, ACTION_REMOVE, removed->id, removed->description, removed->completed);
-                    // Libere a memória da tarefa removida
-                    free(removed->description);
-                    free(removed);
-                }
+                discardLine(); // Limpa o buffer
+                removeTaskCommand(session, id_to_process);
                 break;
             case 5:
-                undoLastAction(&myTasks, &undoStack);
+                undoLastAction(session->list, session->history);
+                break;
+            case 6:
+                redoLastAction(session->list, session->history);
+                break;
+            case 7:
+            case 8:
+                printf("Digite quantas ações deseja %s: ", choice == 7 ? "desfazer" : "refazer");
+                if (scanf("%d", &action_count) != 1 || action_count < 0) {
+                    printf("Entrada inválida. Por favor, digite um número.\n");
+                    discardLine();
+                    break;
+                }
+                discardLine(); // Limpa o buffer
+                replayActions(session->list, session->history, choice == 7, (size_t)action_count);
+                break;
+            case 9:
+                printf("Digite o caminho do arquivo (uma tarefa por linha): ");
+                if (fgets(description, sizeof(description), stdin) != NULL) {
+                    description[strcspn(description, "\n")] = 0; // Remove o newline
+                    importTasksCommand(session, description);
+                } else {
+                    printf("Erro ao ler o caminho.\n");
+                }
+                break;
+            case 10: {
+                printf("Digite o filtro (ex.: pending 10-50 20 40 = pendentes de ID 10 a 50, 20 por página, pulando 40; sorted = em ordem de ID): ");
+                if (fgets(description, sizeof(description), stdin) == NULL) {
+                    printf("Erro ao ler o filtro.\n");
+                    break;
+                }
+                description[strcspn(description, "\n")] = 0; // Remove o newline
+                TaskFilter filter;
+                if (parseListFilter(description, &filter)) {
+                    listTasksFiltered(session->list, &filter);
+                } else {
+                    printf("Filtro inválido.\n");
+                }
+                break;
+            }
+            case 11:
+                printf("Digite as palavras a buscar: ");
+                if (fgets(description, sizeof(description), stdin) != NULL) {
+                    description[strcspn(description, "\n")] = 0; // Remove o newline
+                    searchTasks(session->list, description);
+                } else {
+                    printf("Erro ao ler a busca.\n");
+                }
+                break;
+            case 12:
+                printf("Digite o trecho a buscar: ");
+                if (fgets(description, sizeof(description), stdin) != NULL) {
+                    description[strcspn(description, "\n")] = 0; // Remove o newline
+                    findTasks(session->list, description);
+                } else {
+                    printf("Erro ao ler a busca.\n");
+                }
+                break;
+            case 13:
+                printStats(session->list, 0, INT_MAX);
+                printCounters(session->history);
+                break;
+            case 14:
+            case 15: {
+                IdSet set;
+                printf("Digite os IDs a %s (ex.: 1,5,10-50): ", choice == 14 ? "concluir" : "remover");
+                if (fgets(description, sizeof(description), stdin) == NULL) {
+                    printf("Erro ao ler os IDs.\n");
+                    break;
+                }
+                description[strcspn(description, "\n")] = 0; // Remove o newline
+                if (!parseIdSet(description, &set, session->list->next_id - 1)) {
+                    printf("Lista de IDs inválida.\n");
+                } else if (choice == 14) {
+                    completeSetCommand(session, &set);
+                } else {
+                    removeSetCommand(session, &set);
+                }
+                break;
+            }
+            case 16: {
+                int priority;
+                int32_t due;
+                printf("Digite o ID da tarefa: ");
+                if (scanf("%d", &id_to_process) != 1) {
+                    printf("Entrada inválida para ID.\n");
+                    discardLine();
+                    break;
+                }
+                printf("Digite a prioridade (0 a %d): ", MAX_PRIORITY);
+                if (scanf("%d", &priority) != 1 || priority < 0 || priority > MAX_PRIORITY) {
+                    printf("Prioridade inválida.\n");
+                    discardLine();
+                    break;
+                }
+                discardLine();
+                printf("Digite o prazo (AAAA-MM-DD, ou - para nenhum): ");
+                if (fgets(description, sizeof(description), stdin) == NULL) {
+                    printf("Erro ao ler o prazo.\n");
+                    break;
+                }
+                description[strcspn(description, "\n")] = 0; // Remove o newline
+                if (!parseDueDate(description, &due)) {
+                    printf("Prazo inválido.\n");
+                } else {
+                    scheduleTaskCommand(session, id_to_process, priority, due);
+                }
                 break;
+            }
+            case 17: {
+                printf("Quantas tarefas mostrar: ");
+                if (scanf("%d", &id_to_process) != 1 || id_to_process < 1) {
+                    printf("Quantidade inválida.\n");
+                    discardLine();
+                    break;
+                }
+                discardLine();
+                nextTasks(session->list, (size_t)id_to_process);
+                break;
+            }
             case 0:
                 printf("Saindo do Gerenciador de Tarefas. Até mais!\n");
                 break;
@@ -392,10 +6055,410 @@ int main() {
                 printf("Opção inválida. Por favor, tente novamente.\n");
         }
     } while (choice != 0);
+}
+
+// --- Modo de Benchmark (mede as operações da lista e do histórico) ---
+
+// Máximo de latências guardadas por cenário; acima disso, mede uma operação a cada tantas
+#define BENCH_SAMPLES (1 << 20)
+
+// Máximo de tamanhos de lista num único --bench
+#define BENCH_MAX_SIZES 16
+
+// Estado compartilhado pelas operações de um cenário
+typedef struct {
+    Session *session;
+    int *ids;          // Permutação aleatória dos IDs 1..size
+    size_t size;       // Tamanho da lista do cenário
+    uint64_t rng;      // Estado do gerador xorshift64
+    unsigned int undo_percent; // Chance de desfazer em cada passo da mistura
+    bool dense_ids;    // Listas com --dense-ids
+} BenchContext;
+
+// Uma operação medida; 'i' é o número da operação dentro do cenário
+typedef void (*BenchOp)(BenchContext *ctx, size_t i);
+
+// Relógio monotônico em nanossegundos
+uint64_t benchNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Próximo número pseudoaleatório (xorshift64, reprodutível entre execuções)
+uint64_t benchRandom(BenchContext *ctx) {
+    ctx->rng ^= ctx->rng << 13;
+    ctx->rng ^= ctx->rng >> 7;
+    ctx->rng ^= ctx->rng << 17;
+    return ctx->rng;
+}
+
+// Largura para o printf alinhar 'text' em 'width' colunas: os bytes de
+// continuação do UTF-8 não ocupam coluna
+int benchWidth(const char *text, int width) {
+    for (const char *p = text; *p != '\0'; p++) {
+        width += ((unsigned char)*p & 0xC0) == 0x80;
+    }
+    return width;
+}
+
+// Ordena as latências em ordem crescente
+int compareSamples(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Executa 'ops' vezes a operação e imprime vazão e latências (p50/p99)
+// A vazão vem do tempo total; as latências, de uma operação a cada 'stride'
+void runBenchCase(BenchContext *ctx, const char *name, size_t ops, BenchOp op) {
+    size_t stride = ops / BENCH_SAMPLES + 1;
+    uint64_t *samples = (uint64_t *)malloc((ops / stride + 1) * sizeof(uint64_t));
+    if (!samples) {
+        perror("Erro ao alocar memória para o benchmark");
+        exit(EXIT_FAILURE);
+    }
+    size_t count = 0;
+    uint64_t start = benchNow();
+    for (size_t i = 0; i < ops; i++) {
+        if (i % stride == 0) {
+            uint64_t t0 = benchNow();
+            op(ctx, i);
+            samples[count++] = benchNow() - t0;
+        } else {
+            op(ctx, i);
+        }
+    }
+    double seconds = (double)(benchNow() - start) / 1e9;
+    qsort(samples, count, sizeof(uint64_t), compareSamples);
+    printf("%-*s %10zu %14.0f %12llu %12llu\n", benchWidth(name, 28), name, ops, seconds > 0 ? (double)ops / seconds : 0.0,
+           count ? (unsigned long long)samples[count / 2] : 0ULL,
+           count ? (unsigned long long)samples[count * 99 / 100] : 0ULL);
+    fflush(stdout);
+    free(samples);
+}
+
+void benchAdd(BenchContext *ctx, size_t i) {
+    (void)i;
+    addTaskCommand(ctx->session, "Tarefa de benchmark");
+}
+
+void benchCompleteSequential(BenchContext *ctx, size_t i) {
+    completeTaskCommand(ctx->session, (int)i + 1);
+}
+
+void benchCompleteRandom(BenchContext *ctx, size_t i) {
+    completeTaskCommand(ctx->session, ctx->ids[i]);
+}
+
+void benchRemoveSequential(BenchContext *ctx, size_t i) {
+    removeTaskCommand(ctx->session, (int)i + 1);
+}
+
+void benchRemoveRandom(BenchContext *ctx, size_t i) {
+    removeTaskCommand(ctx->session, ctx->ids[i]);
+}
+
+void benchList(BenchContext *ctx, size_t i) {
+    (void)i;
+    listTasks(ctx->session->list);
+}
+
+void benchUndo(BenchContext *ctx, size_t i) {
+    (void)i;
+    undoLastAction(ctx->session->list, ctx->session->history);
+}
+
+// Um passo da mistura: desfaz com a chance configurada; senão adiciona,
+// conclui ou remove uma tarefa de ID aleatório (que pode já não existir)
+void benchMixed(BenchContext *ctx, size_t i) {
+    (void)i;
+    uint64_t r = benchRandom(ctx);
+    if (r % 100 < ctx->undo_percent) {
+        undoLastAction(ctx->session->list, ctx->session->history);
+        return;
+    }
+    int last_id = ctx->session->list->next_id > 1 ? ctx->session->list->next_id - 1 : 1;
+    int id = (int)((r >> 8) % (uint64_t)last_id) + 1;
+    switch ((r >> 40) % 3) {
+        case 0:
+            addTaskCommand(ctx->session, "Tarefa de benchmark");
+            break;
+        case 1:
+            completeTaskCommand(ctx->session, id);
+            break;
+        default:
+            removeTaskCommand(ctx->session, id);
+            break;
+    }
+}
+
+// Recomeça com a lista e o histórico vazios e, com 'fill', 'size' tarefas já criadas
+void resetBench(BenchContext *ctx, TaskLayout layout, size_t undo_depth, bool fill) {
+    Session *session = ctx->session;
+    destroyTaskList(session->list);
+    destroyHistory(session->history);
+    initTaskList(session->list);
+    setTaskListLayout(session->list, layout);
+    initHistory(session->history, session->list, undo_depth, NULL);
+    if (ctx->dense_ids) {
+        enableDenseIds(session->list);
+    }
+    for (size_t i = 0; fill && i < ctx->size; i++) {
+        addTaskCommand(session, "Tarefa de benchmark");
+    }
+}
+
+// Mede as operações numa lista de 'size' tarefas
+// Cada grupo de cenários começa de uma lista nova; as mensagens de cada
+// operação e as listagens vão para /dev/null, então só o custo da lista,
+// do histórico e da formatação entra na medida
+void benchSize(size_t size, TaskLayout layout, size_t undo_depth, unsigned int undo_percent, bool dense_ids) {
+    TaskList list;
+    History history;
+    Session session = { &list, &history };
+    BenchContext ctx = { &session, NULL, size, 0x9E3779B97F4A7C15ULL, undo_percent, dense_ids };
+    initTaskList(&list);
+    initHistory(&history, &list, undo_depth, NULL);
+
+    ctx.ids = (int *)malloc(size * sizeof(int));
+    if (!ctx.ids) {
+        perror("Erro ao alocar memória para o benchmark");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < size; i++) {
+        ctx.ids[i] = (int)i + 1;
+    }
+    for (size_t i = size; i > 1; i--) { // Fisher-Yates
+        size_t j = (size_t)(benchRandom(&ctx) % i);
+        int t = ctx.ids[i - 1];
+        ctx.ids[i - 1] = ctx.ids[j];
+        ctx.ids[j] = t;
+    }
+    size_t listings = size >= 1000000 ? 3 : size >= 100000 ? 10 : 100;
+
+    printf("\n--- Benchmark: %zu tarefas (layout %s%s) ---\n", size, layout == LAYOUT_COLUMNS ? "soa" : "linked",
+           dense_ids ? ", IDs densos" : "");
+    printf("%-*s %*s %14s %12s %12s\n", benchWidth("Cenário", 28), "Cenário", benchWidth("Operações", 10), "Operações",
+           "Ops/s", "p50 (ns)", "p99 (ns)");
+
+    resetBench(&ctx, layout, undo_depth, false);
+    runBenchCase(&ctx, "adicionar", size, benchAdd);
+    runBenchCase(&ctx, "listar (lista inteira)", listings, benchList);
+    runBenchCase(&ctx, "concluir (sequencial)", size, benchCompleteSequential);
+    runBenchCase(&ctx, "desfazer conclusões", size, benchUndo);
+    runBenchCase(&ctx, "remover (sequencial)", size, benchRemoveSequential);
+
+    resetBench(&ctx, layout, undo_depth, true);
+    runBenchCase(&ctx, "concluir (aleatório)", size, benchCompleteRandom);
+    runBenchCase(&ctx, "remover (aleatório)", size, benchRemoveRandom);
+    runBenchCase(&ctx, "desfazer remoções", size, benchUndo);
+
+    char name[64];
+    snprintf(name, sizeof(name), "mistura (%u%% desfazer)", undo_percent);
+    resetBench(&ctx, layout, undo_depth, true);
+    runBenchCase(&ctx, name, size, benchMixed);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Pico de memória (RSS): %ld KB\n", usage.ru_maxrss);
+
+    free(ctx.ids);
+    destroyTaskList(&list);
+    destroyHistory(&history);
+}
+
+// Roda o benchmark para cada tamanho da lista separada por vírgulas 'sizes'
+// O pico de memória é do processo inteiro, então só cresce de um tamanho para o outro
+bool runBench(const char *sizes, TaskLayout layout, size_t undo_depth, unsigned int undo_percent, bool dense_ids) {
+    size_t values[BENCH_MAX_SIZES];
+    size_t count = 0;
+    for (const char *p = sizes; *p != '\0'; ) {
+        char *end;
+        errno = 0;
+        long long value = strtoll(p, &end, 10);
+        if (end == p || errno != 0 || value < 1 || value > INT_MAX - 1 || count == BENCH_MAX_SIZES ||
+            (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "Tamanhos inválidos para --bench: %s\n", sizes);
+            return false;
+        }
+        values[count++] = (size_t)value;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    FILE *sink = fopen("/dev/null", "w");
+    if (!sink) {
+        perror("/dev/null");
+        return false;
+    }
+    bool was_quiet = quiet_mode;
+    quiet_mode = true;
+    thread_output = sink; // Mensagens e listagens das operações
+    for (size_t i = 0; i < count; i++) {
+        benchSize(values[i], layout, undo_depth, undo_percent, dense_ids);
+    }
+    thread_output = NULL;
+    quiet_mode = was_quiet;
+    fclose(sink);
+    return true;
+}
+
+// Mostra as opções de linha de comando
+void printUsage(const char *program) {
+    printf("Uso: %s [opções]\n", program);
+    printf("  --undo-depth N     Lembra no máximo N ações para desfazer (0 = sem limite)\n");
+    printf("  --data-dir DIR     Guarda as tarefas em DIR (snapshot + diário) entre execuções\n");
+    printf("  --compact-every N  Gera um snapshot novo a cada N registros do diário (padrão: 10000)\n");
+    printf("  --sync-window MS   Grava o diário em segundo plano, agrupando os registros de\n");
+    printf("                     até MS milissegundos (padrão: 10; 0 = grava a cada ação)\n");
+    printf("  --sync-records N   Grava antes do fim da janela ao juntar N registros (padrão: 1024)\n");
+    printf("  --batch [ARQUIVO]  Executa comandos de ARQUIVO (ou da entrada padrão) sem menu:\n");
+    printf("                     add <descrição>, done <ids>, rm <ids>, import <arquivo>,\n");
+    printf("                     undo [n], redo [n], list [all|pending|done] [sorted] [A-B]\n");
+    printf("                     [limite [deslocamento]], search <palavras>,\n");
+    printf("                     find <trecho>, stats [A-B], sync, prio <id> <0-9>,\n");
+    printf("                     due <id> <AAAA-MM-DD|->, next [n]\n");
+    printf("                     <ids> é um ID ou uma lista com intervalos (ex.: 1,5,10-20)\n");
+    printf("  --serve SOCKET     Atende vários clientes pelo socket Unix SOCKET, com os\n");
+    printf("                     comandos do modo em lote e um histórico por cliente\n");
+    printf("  --dense-ids        Indexa o mapa de conclusão por posições reaproveitadas, e\n");
+    printf("                     não pelos IDs, que continuam só crescendo\n");
+    printf("  --stats-every N    Escreve os contadores em stderr, numa linha chave=valor, a\n");
+    printf("                     cada N comandos do modo em lote ou do servidor\n");
+    printf("  --quiet            Não imprime a confirmação de cada operação\n");
+    printf("  --layout TIPO      Organização da memória: linked (padrão) ou soa (colunas\n");
+    printf("                     paralelas para varreduras por estado)\n");
+    printf("  --bench TAMANHOS   Mede as operações em listas dos tamanhos dados, separados\n");
+    printf("                     por vírgulas (ex.: 1000,100000,10000000), e sai\n");
+    printf("  --bench-undo PCT   Chance de desfazer em cada passo da mistura (padrão: 50)\n");
+}
+
+// Converte um argumento numérico não negativo; encerra com mensagem se inválido
+size_t parseCountOption(const char *option, const char *value) {
+    char *end;
+    long long number = strtoll(value, &end, 10);
+    if (*end != '\0' || number < 0) {
+        fprintf(stderr, "Valor inválido para %s: %s\n", option, value);
+        exit(EXIT_FAILURE);
+    }
+    return (size_t)number;
+}
+
+// --- Função Principal (main) ---
+int main(int argc, char *argv[]) {
+    TaskList myTasks;
+    History history;
+    TaskStore store;
+    size_t undo_depth = 0; // Sem limite, a menos que --undo-depth seja informado
+    const char *data_dir = NULL; // Sem persistência, a menos que --data-dir seja informado
+    size_t compact_every = 10000;
+    size_t sync_window_ms = 10;
+    size_t sync_records = 1024;
+    bool batch = false;
+    const char *batch_file = NULL; // NULL = entrada padrão
+    const char *socket_path = NULL; // Sem servidor, a menos que --serve seja informado
+    TaskLayout layout = LAYOUT_LINKED;
+    bool dense_ids = false;
+    const char *bench_sizes = NULL; // Sem benchmark, a menos que --bench seja informado
+    size_t bench_undo = 50;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--undo-depth") == 0 && i + 1 < argc) {
+            undo_depth = parseCountOption(argv[i], argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--data-dir") == 0 && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (strcmp(argv[i], "--compact-every") == 0 && i + 1 < argc) {
+            compact_every = parseCountOption(argv[i], argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--sync-window") == 0 && i + 1 < argc) {
+            sync_window_ms = parseCountOption(argv[i], argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--sync-records") == 0 && i + 1 < argc) {
+            sync_records = parseCountOption(argv[i], argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                batch_file = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_sizes = argv[++i];
+        } else if (strcmp(argv[i], "--bench-undo") == 0 && i + 1 < argc) {
+            bench_undo = parseCountOption(argv[i], argv[i + 1]);
+            if (bench_undo > 100) {
+                fprintf(stderr, "Valor inválido para %s: %s\n", argv[i], argv[i + 1]);
+                return EXIT_FAILURE;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--stats-every") == 0 && i + 1 < argc) {
+            stats_every = parseCountOption(argv[i], argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--dense-ids") == 0) {
+            dense_ids = true;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet_mode = true;
+        } else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc &&
+                   (strcmp(argv[i + 1], "linked") == 0 || strcmp(argv[i + 1], "soa") == 0)) {
+            layout = strcmp(argv[++i], "soa") == 0 ? LAYOUT_COLUMNS : LAYOUT_LINKED;
+        } else {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (bench_sizes != NULL) {
+        return runBench(bench_sizes, layout, undo_depth, (unsigned int)bench_undo, dense_ids) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int batch_fd = STDIN_FILENO;
+    if (batch_file != NULL && strcmp(batch_file, "-") != 0) {
+        batch_fd = open(batch_file, O_RDONLY);
+        if (batch_fd < 0) {
+            perror(batch_file);
+            return EXIT_FAILURE;
+        }
+    }
+
+    initTaskList(&myTasks);
+    setTaskListLayout(&myTasks, layout);
+    initTaskStore(&store, &myTasks);
+    if (data_dir != NULL && !openTaskStore(&store, data_dir, compact_every)) {
+        closeTaskStore(&store);
+        destroyTaskList(&myTasks);
+        return EXIT_FAILURE;
+    }
+    if (dense_ids) {
+        enableDenseIds(&myTasks);
+    }
+    if (socket_path != NULL) {
+        blockStopSignals(NULL); // Antes de qualquer thread, que herda a máscara
+    }
+    startJournalWriter(&store, sync_window_ms > UINT_MAX ? UINT_MAX : (unsigned int)sync_window_ms, sync_records);
+    initHistory(&history, &myTasks, undo_depth, data_dir != NULL ? &store : NULL);
+
+    Session session = { &myTasks, &history };
+    int status = EXIT_SUCCESS;
+    if (socket_path != NULL) {
+        if (!runServer(&session, socket_path)) {
+            status = EXIT_FAILURE;
+        }
+    } else if (batch) {
+        if (runBatch(&session, batch_fd) > 0) {
+            status = EXIT_FAILURE;
+        }
+        if (batch_fd != STDIN_FILENO) {
+            close(batch_fd);
+        }
+    } else {
+        runInteractiveMenu(&session);
+    }
 
-    // Libera toda a memória
+    // Grava o snapshot final e libera toda a memória
+    closeTaskStore(&store);
     destroyTaskList(&myTasks);
-    destroyActionStack(&undoStack);
+    destroyHistory(&history);
 
-    return 0;
+    return status;
 }